@@ -0,0 +1,48 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include "stats.hpp"
+
+// Counting replacements of the global allocation functions, feeding
+// threadBytesAllocated() for --stats. Only the lox binary links them, so
+// that libraries, tests and benchmarks keep the standard allocator. The
+// array and nothrow forms default to calling these.
+
+#if LOX_STATS
+
+namespace {
+
+// Retries @alloc until it succeeds, calling the new_handler in between as
+// the standard requires, or throws std::bad_alloc if there is none.
+template <typename Alloc> void* allocate(Alloc alloc) {
+  while (true) {
+    if (void* p = alloc()) return p;
+    std::new_handler handler = std::get_new_handler();
+    if (not handler) throw std::bad_alloc();
+    handler();
+  }
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  lox::internal::bytesAllocated += size;
+  return allocate([size] { return std::malloc(size ? size : 1); });
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+  lox::internal::bytesAllocated += size;
+  const size_t a = static_cast<size_t>(align);
+  // aligned_alloc() wants a nonzero multiple of the alignment.
+  const size_t n = std::max<size_t>((size + a - 1) / a * a, a);
+  return allocate([a, n] { return std::aligned_alloc(a, n); });
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+#endif  // LOX_STATS
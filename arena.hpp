@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lox {
+
+// Bump allocator. Objects are carved out of large contiguous blocks and are
+// all released together when the arena is destroyed; their destructors never
+// run, so only trivially destructible types may be allocated here.
+class Arena {
+ public:
+  static constexpr size_t kInitialBlockSize = 4 << 10;
+  static constexpr size_t kMaxBlockSize = 1 << 20;
+
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t align) {
+    const uintptr_t p = alignUp(cur_, align);
+    if (cur_ == nullptr || p + size > reinterpret_cast<uintptr_t>(end_)) {
+      return allocateSlow(size, align);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+  }
+
+  template <typename T, typename... Args> T* make(Args&&... args) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena allocated types must be trivially destructible");
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Total bytes reserved from the system for this arena's blocks.
+  size_t bytesReserved() const { return reserved_; }
+
+ private:
+  static uintptr_t alignUp(const char* p, size_t align) {
+    return (reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1);
+  }
+  void* allocateSlow(size_t size, size_t align) {
+    // Oversized requests get a dedicated block so the current block can
+    // keep serving small allocations.
+    const size_t needed = size + align;
+    if (needed > nextBlockSize_ / 4) {
+      return reinterpret_cast<void*>(alignUp(newBlock(needed), align));
+    }
+    cur_ = newBlock(nextBlockSize_);
+    end_ = cur_ + nextBlockSize_;
+    nextBlockSize_ = std::min(nextBlockSize_ * 2, kMaxBlockSize);
+    return allocate(size, align);
+  }
+  char* newBlock(size_t size) {
+    blocks_.emplace_back(new char[size]);
+    reserved_ += size;
+    return blocks_.back().get();
+  }
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+  size_t nextBlockSize_ = kInitialBlockSize;
+  size_t reserved_ = 0;
+};
+
+}  // namespace lox
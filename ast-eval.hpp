@@ -1,39 +1,19 @@
-#include <any>
+#pragma once
+
 #include <string>
-#include <variant>
+#include <utility>
+#include <vector>
 #include "ast.hpp"
+#include "flat-ast.hpp"
+#include "profiler.hpp"
+#include "stats.hpp"
 #include "token.hpp"
+#include "trace.hpp"
+#include "value.hpp"
 
 namespace lox {
 namespace ast {
 
-enum class ValueType { NIL = 0, BOOL = 1, NUMBER = 2, STRING = 3 };
-
-class Value {
- public:
-  static Value Nil() {
-    Value v;
-    v.setNil();
-    return v;
-  }
-  Value() = default;
-  Value(bool b) { setBool(b); }
-  Value(double d) { setDouble(d); }
-  Value(const std::string& s) { setString(s); }
-  void setNil() { v_.emplace<0>(); }
-  void setBool(bool b) { v_.emplace<1>(b); }
-  void setDouble(double d) { v_.emplace<2>(d); }
-  void setString(const std::string& s) { v_.emplace<3>(s); }
-  ValueType type() const { return static_cast<ValueType>(v_.index()); }
-  bool b() const { return std::get<1>(v_); }
-  double d() const { return std::get<2>(v_); }
-  const std::string& s() const { return std::get<3>(v_); }
-  bool equals(const Value& o) const { return v_ == o.v_; }
-
- private:
-  std::variant<std::true_type, bool, double, std::string> v_;
-};
-
 class Evaluator {
  public:
   struct Status {
@@ -44,125 +24,313 @@ class Evaluator {
     std::string message;
     Token token;  // location for the error.
   };
-  static Status eval(Node* node, Value* value) {
-    try {
-      EvalVisitor visitor;
-      auto valAny = node->accept(&visitor);
-      auto* val = std::any_cast<Value>(&valAny);
-      *value = *val;
-    } catch (const Status& s) {
-      return s;
+  // If @visits is given, the number of nodes evaluated is added to it
+  // when statistics are compiled in.
+  static Status eval(const Node* node, Value* value,
+                     uint64_t* visits = nullptr) {
+    Walker walker;
+    Status status = walker.run(node, value);
+    if (visits) *visits += walker.visits;
+    return status;
+  }
+  // Evaluates a flat tree in one linear pass. Because nodes are stored in
+  // post-order, the operands of every node are the topmost values on the
+  // stack by the time the node is reached. An empty tree, which decode()
+  // accepts, is an error.
+  static Status eval(const FlatTree& tree, Value* value,
+                     uint64_t* visits = nullptr) {
+    if (tree.empty()) return Status{"Empty program", Token()};
+    std::vector<Value> stack;
+    for (FlatTree::Index i = 0; i < tree.size(); ++i) {
+      if constexpr (kStatsEnabled) {
+        if (visits) ++*visits;
+      }
+      switch (tree.kind(i)) {
+        case FlatTree::Kind::NUMBER:
+          stack.emplace_back(tree.number(i));
+          break;
+        case FlatTree::Kind::STRING:
+          stack.emplace_back(tree.string(i));
+          break;
+        case FlatTree::Kind::BOOL:
+          stack.emplace_back(tree.boolean(i));
+          break;
+        case FlatTree::Kind::NIL:
+          stack.emplace_back();
+          break;
+        case FlatTree::Kind::UNARY: {
+          Value& operand = stack.back();
+          const char* error = unary(tree.unaryOp(i), operand, &operand);
+          if (error) return Status{error, tree.opToken(i)};
+          break;
+        }
+        case FlatTree::Kind::BINARY: {
+          Value& first = stack[stack.size() - 2];
+          const char* error =
+              binary(tree.binaryOp(i), first, stack.back(), &first);
+          if (error) return Status{error, tree.opToken(i)};
+          stack.pop_back();
+          break;
+        }
+      }
     }
+    *value = std::move(stack.back());
     return {};
   }
 
- private:
-  struct EvalVisitor : public Visitor {
-    static bool isTruthy(Value v) {
-      return v.type() != ValueType::NIL &&
-             (v.type() != ValueType::BOOL || v.b());
-    }
-    std::any visitNumber(const Number* obj) override {
-      return Value(obj->val);
-    }
-    std::any visitString(const String* obj) override {
-      return Value(obj->val);
-    }
-    std::any visitBool(const Bool* obj) override {
-      return Value(obj->val);
-    }
-    std::any visitNil(const Nil*) override { return Value::Nil(); }
-    std::any visitUnary(const Unary* obj) override {
-      auto operandAny = obj->operand->accept(this);
-      auto* operand = std::any_cast<Value>(&operandAny);
-      switch (obj->op) {
-        case Unary::MINUS: {
-          if (operand->type() != ValueType::NUMBER) {
-            throw Status{"Unary '-' expects numeric argument", obj->opToken};
-          }
-          return Value(-operand->d());
-        }
-        case Unary::BANG: {
-          return Value(isTruthy(*operand));
+  // Applies @op to an evaluated operand. Returns nullptr on success, or the
+  // runtime error message. @out may alias the operand.
+  static const char* unary(Unary::Operator op, const Value& operand,
+                           Value* out) {
+    switch (op) {
+      case Unary::MINUS: {
+        if (operand.type() != ValueType::NUMBER) {
+          return "Unary '-' expects numeric argument";
         }
+        *out = Value(-operand.d());
+        return nullptr;
+      }
+      case Unary::BANG: {
+        *out = Value(not isTruthy(operand));
+        return nullptr;
       }
-      throw Status{"Unexpected operator", obj->opToken};
     }
-    std::any visitBinary(const Binary* obj) override {
-      auto firstAny = obj->first->accept(this);
-      auto* first = std::any_cast<Value>(&firstAny);
-      auto secondAny = obj->second->accept(this);
-      auto* second = std::any_cast<Value>(&secondAny);
-      switch (obj->op) {
-        case Binary::MINUS: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"Binary '-' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() - second->d());
+    return "Unexpected operator";
+  }
+  // Applies @op to evaluated operands. Returns nullptr on success, or the
+  // runtime error message. @out may alias either operand.
+  static const char* binary(Binary::Operator op, const Value& first,
+                            const Value& second, Value* out) {
+    switch (op) {
+      case Binary::MINUS: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "Binary '-' expects numeric arguments";
         }
-        case Binary::PLUS: {
-          if (first->type() == ValueType::NUMBER &&
-              second->type() == ValueType::NUMBER) {
-            return Value(first->d() + second->d());
-          } else if (first->type() == ValueType::STRING &&
-                     second->type() == ValueType::STRING) {
-            return Value(first->s() + second->s());
-          }
-          throw Status{
-              "'+' expects both numeric or string arguments", obj->opToken};
+        *out = Value(first.d() - second.d());
+        return nullptr;
+      }
+      case Binary::PLUS: {
+        if (first.type() == ValueType::NUMBER &&
+            second.type() == ValueType::NUMBER) {
+          *out = Value(first.d() + second.d());
+          return nullptr;
+        } else if (first.type() == ValueType::STRING &&
+                   second.type() == ValueType::STRING) {
+          *out = Value::concat(first, second);
+          return nullptr;
         }
-        case Binary::SLASH: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'/' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() / second->d());;
+        return "'+' expects both numeric or string arguments";
+      }
+      case Binary::SLASH: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'/' expects numeric arguments";
         }
-        case Binary::STAR: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'*' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() * second->d());;
+        *out = Value(first.d() / second.d());
+        return nullptr;
+      }
+      case Binary::STAR: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'*' expects numeric arguments";
         }
-        case Binary::BANG_EQUAL: {
-          return Value(not first->equals(*second));
+        *out = Value(first.d() * second.d());
+        return nullptr;
+      }
+      case Binary::BANG_EQUAL: {
+        *out = Value(not first.equals(second));
+        return nullptr;
+      }
+      case Binary::EQUAL_EQUAL: {
+        *out = Value(first.equals(second));
+        return nullptr;
+      }
+      case Binary::GREATER: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'>' expects numeric arguments";
         }
-        case Binary::EQUAL_EQUAL: {
-          return Value(first->equals(*second));
+        *out = Value(first.d() > second.d());
+        return nullptr;
+      }
+      case Binary::GREATER_EQUAL: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'>=' expects numeric arguments";
         }
-        case Binary::GREATER: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'>' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() > second->d());;
+        *out = Value(first.d() >= second.d());
+        return nullptr;
+      }
+      case Binary::LESS: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'<' expects numeric arguments";
         }
-        case Binary::GREATER_EQUAL: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'>=' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() >= second->d());;
+        *out = Value(first.d() < second.d());
+        return nullptr;
+      }
+      case Binary::LESS_EQUAL: {
+        if (first.type() != ValueType::NUMBER ||
+            second.type() != ValueType::NUMBER) {
+          return "'<=' expects numeric arguments";
         }
-        case Binary::LESS: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'<' expects numeric arguments", obj->opToken};
-          }
-          return Value(first->d() < second->d());;
+        *out = Value(first.d() <= second.d());
+        return nullptr;
+      }
+    }
+    return "Unexpected operator";
+  }
+  static bool isTruthy(const Value& v) {
+    return v.type() != ValueType::NIL &&
+           (v.type() != ValueType::BOOL || v.b());
+  }
+
+ private:
+  // Evaluates a Tree in post-order with an explicit stack, since parsed
+  // trees can be far deeper than the native stack allows recursing. Only
+  // operators are pushed: the walk descends through first operands down to
+  // a literal, then applies every operator whose operands are done.
+  class Walker {
+   public:
+    Status run(const Node* node, Value* value) {
+      while (true) {
+        while (node->kind == Node::Kind::UNARY ||
+               node->kind == Node::Kind::BINARY) {
+          enter(node);
+          node = node->kind == Node::Kind::UNARY
+                     ? static_cast<const Unary*>(node)->operand
+                     : static_cast<const Binary*>(node)->first;
         }
-        case Binary::LESS_EQUAL: {
-          if (first->type() != ValueType::NUMBER ||
-              second->type() != ValueType::NUMBER) {
-            throw Status{"'<=' expects numeric arguments", obj->opToken};
+        literal(node);
+        while (true) {
+          if (pending_.empty()) {
+            *value = std::move(values_.back());
+            return {};
+          }
+          Pending& top = pending_.back();
+          if (top.node->kind == Node::Kind::BINARY && not top.secondDone) {
+            top.secondDone = true;
+            node = static_cast<const Binary*>(top.node)->second;
+            break;
           }
-          return Value(first->d() <= second->d());;
+          const Pending p = top;
+          pending_.pop_back();
+          if (const char* error = leave(p)) return fail(error, p.node);
         }
       }
-      return {};
     }
+
+    uint64_t visits = 0;
+
+   private:
+    // An operator whose operands are being evaluated onto values_.
+    struct Pending {
+      const Node* node;
+      uint64_t begin;  // trace::now() when the visit is sampled.
+      bool sampled;
+      bool secondDone;
+    };
+
+    // Counts a visit. While tracing, one in every sampleInterval visits is
+    // sampled, and @begin set to when it started.
+    bool visit(uint64_t* begin) {
+      if constexpr (kStatsEnabled) ++visits;
+      if (countdown_ != 0 && --countdown_ == 0) {
+        countdown_ = sampleInterval_;
+        *begin = trace::now();
+        return true;
+      }
+      return false;
+    }
+
+    void enter(const Node* node) {
+      Pending p = {node, 0, false, false};
+      p.sampled = visit(&p.begin);
+      // While profiling, operators are evaluated within a frame.
+      if (profiled_) {
+        profile::push(operatorOffset(node));
+        ++frames_;
+      }
+      pending_.push_back(p);
+    }
+
+    void literal(const Node* node) {
+      uint64_t begin = 0;
+      const bool sampled = visit(&begin);
+      switch (node->kind) {
+        case Node::Kind::NUMBER:
+          values_.emplace_back(static_cast<const Number*>(node)->val);
+          break;
+        case Node::Kind::STRING:
+          values_.emplace_back(static_cast<const String*>(node)->val);
+          break;
+        case Node::Kind::BOOL:
+          values_.emplace_back(static_cast<const Bool*>(node)->val);
+          break;
+        default:
+          values_.emplace_back();
+          break;
+      }
+      if (sampled) record(node, begin);
+    }
+
+    // Applies the operator of @p to its evaluated operands. Returns the
+    // runtime error message, if any.
+    const char* leave(const Pending& p) {
+      const char* error;
+      if (p.node->kind == Node::Kind::UNARY) {
+        const auto* obj = static_cast<const Unary*>(p.node);
+        Value& operand = values_.back();
+        error = unary(obj->op, operand, &operand);
+      } else {
+        const auto* obj = static_cast<const Binary*>(p.node);
+        Value& first = values_[values_.size() - 2];
+        error = binary(obj->op, first, values_.back(), &first);
+        values_.pop_back();
+      }
+      if (error) return error;
+      if (profiled_) {
+        profile::pop();
+        --frames_;
+      }
+      if (p.sampled) record(p.node, p.begin);
+      return nullptr;
+    }
+
+    // Closes the frames of the operators being evaluated.
+    Status fail(const char* error, const Node* node) {
+      for (; frames_ > 0; --frames_) profile::pop();
+      return Status{error, operatorToken(node)};
+    }
+
+    // Records the sampled visit of @node as a trace span, annotated with
+    // the location of the node's operator if it has one.
+    static void record(const Node* node, uint64_t begin) {
+      static const char* const kNames[] = {"Number", "String", "Bool",
+                                           "Nil",    "Unary",  "Binary"};
+      const bool literal = node->kind != Node::Kind::UNARY &&
+                           node->kind != Node::Kind::BINARY;
+      trace::recordSample(kNames[static_cast<int>(node->kind)], begin,
+                          trace::now(),
+                          literal ? -1 : operatorOffset(node));
+    }
+    static Token operatorToken(const Node* node) {
+      return node->kind == Node::Kind::UNARY
+                 ? static_cast<const Unary*>(node)->opToken
+                 : static_cast<const Binary*>(node)->opToken;
+    }
+    static int64_t operatorOffset(const Node* node) {
+      return operatorToken(node).location();
+    }
+
+    std::vector<Pending> pending_;
+    std::vector<Value> values_;
+    const uint32_t sampleInterval_ = trace::sampleInterval();
+    uint32_t countdown_ = sampleInterval_;
+    const bool profiled_ = profile::active();
+    // Profile frames pushed and not yet popped.
+    int64_t frames_ = 0;
   };
 };
 
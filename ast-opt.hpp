@@ -0,0 +1,167 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "ast-eval.hpp"
+#include "ast.hpp"
+#include "value.hpp"
+
+namespace lox {
+namespace ast {
+
+// Optimization passes over a parsed Tree.
+class Optimizer {
+ public:
+  // Replaces every constant subtree of @tree with the literal it evaluates
+  // to. Operators whose evaluation fails are kept, with their operands
+  // folded, so that the error is still raised at run time, in the same
+  // order and at the same opToken as without folding. New nodes are
+  // allocated in the tree's arena, and folded strings are owned by the tree.
+  static void foldConstants(Tree* tree) {
+    if (not *tree) return;
+    Folder folder(tree);
+    tree->setRoot(folder.fold(tree->get()));
+  }
+
+ private:
+  static bool isLiteral(const Node* node) {
+    return node->kind != Node::Kind::UNARY &&
+           node->kind != Node::Kind::BINARY;
+  }
+  static Value literalValue(const Node* node) {
+    switch (node->kind) {
+      case Node::Kind::NUMBER:
+        return Value(static_cast<const Number*>(node)->val);
+      case Node::Kind::STRING:
+        return Value(static_cast<const String*>(node)->val);
+      case Node::Kind::BOOL:
+        return Value(static_cast<const Bool*>(node)->val);
+      default:
+        return Value::Nil();
+    }
+  }
+
+  // Folds in post-order with an explicit stack, since parsed trees can be
+  // far deeper than the native stack allows recursing. Constant subtrees
+  // are folded as Values, and a literal node is only made where folding
+  // stops: a chain of string concatenations builds one rope and one
+  // string rather than a string for every prefix.
+  class Folder {
+   public:
+    explicit Folder(Tree* tree) : tree_(tree) {}
+
+    const Node* fold(const Node* root) {
+      std::vector<std::pair<const Node*, bool>> stack = {{root, false}};
+      while (not stack.empty()) {
+        const auto [node, childrenDone] = stack.back();
+        stack.pop_back();
+        if (isLiteral(node)) {
+          results_.push_back({node, literalValue(node), true});
+        } else if (not childrenDone) {
+          stack.push_back({node, true});
+          if (node->kind == Node::Kind::UNARY) {
+            stack.push_back({static_cast<const Unary*>(node)->operand, false});
+          } else {
+            const auto* binary = static_cast<const Binary*>(node);
+            stack.push_back({binary->second, false});
+            stack.push_back({binary->first, false});
+          }
+        } else if (node->kind == Node::Kind::UNARY) {
+          foldUnary(static_cast<const Unary*>(node));
+        } else {
+          foldBinary(static_cast<const Binary*>(node));
+        }
+      }
+      return materialize(&results_.back());
+    }
+
+   private:
+    // A folded subtree: either a constant @value, whose @node is null until
+    // one is needed, or the non-constant @node.
+    struct Folded {
+      const Node* node;
+      Value value;
+      bool constant;
+    };
+
+    void foldUnary(const Unary* obj) {
+      Folded operand = std::move(results_.back());
+      results_.pop_back();
+      if (operand.constant) {
+        Value result;
+        if (not Evaluator::unary(obj->op, operand.value, &result)) {
+          results_.push_back({nullptr, std::move(result), true});
+          return;
+        }
+      }
+      const Node* folded = materialize(&operand);
+      if (folded == obj->operand) {
+        results_.push_back({obj, Value(), false});
+        return;
+      }
+      auto* unary = tree_->arena()->make<Unary>(*obj);
+      unary->operand = folded;
+      results_.push_back({unary, Value(), false});
+    }
+
+    void foldBinary(const Binary* obj) {
+      Folded second = std::move(results_.back());
+      results_.pop_back();
+      Folded first = std::move(results_.back());
+      results_.pop_back();
+      if (first.constant && second.constant) {
+        Value result;
+        if (not Evaluator::binary(obj->op, first.value, second.value,
+                                  &result)) {
+          results_.push_back({nullptr, std::move(result), true});
+          return;
+        }
+      }
+      const Node* foldedFirst = materialize(&first);
+      const Node* foldedSecond = materialize(&second);
+      if (foldedFirst == obj->first && foldedSecond == obj->second) {
+        results_.push_back({obj, Value(), false});
+        return;
+      }
+      auto* binary = tree_->arena()->make<Binary>(*obj);
+      binary->first = foldedFirst;
+      binary->second = foldedSecond;
+      results_.push_back({binary, Value(), false});
+    }
+
+    const Node* materialize(Folded* folded) {
+      if (not folded->node) folded->node = makeLiteral(folded->value);
+      return folded->node;
+    }
+
+    const Node* makeLiteral(const Value& value) {
+      Arena* arena = tree_->arena();
+      switch (value.type()) {
+        case ValueType::NUMBER: {
+          auto* number = arena->make<Number>();
+          number->val = value.d();
+          return number;
+        }
+        case ValueType::STRING: {
+          auto* str = arena->make<String>();
+          str->val = tree_->addString(value.s());
+          return str;
+        }
+        case ValueType::BOOL: {
+          auto* boolean = arena->make<Bool>();
+          boolean->val = value.b();
+          return boolean;
+        }
+        default:
+          return arena->make<Nil>();
+      }
+    }
+
+    Tree* tree_;
+    std::vector<Folded> results_;
+  };
+};
+
+}  // namespace ast
+}  // namespace lox
@@ -1,116 +1,234 @@
-#include <any>
+#pragma once
+
 #include <fmt/format.h>
-#include <sstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
 #include "ast.hpp"
+#include "flat-ast.hpp"
 
 namespace lox {
 namespace ast {
 
 class Printer {
  public:
-  static std::string print(Node* node, bool multiLine = false) {
-    PrintVisitor visitor(multiLine);
-    auto printedAny = node->accept(&visitor);
-    auto* printed = std::any_cast<Serialized>(&printedAny);
-    return printed->s;
+  static std::string print(const Node* node, bool multiLine = false) {
+    return Writer<NodeAccess>(NodeAccess(), multiLine).write(node);
+  }
+
+  // An empty tree prints as nothing.
+  static std::string print(const FlatTree& tree, bool multiLine = false) {
+    if (tree.empty()) return "";
+    return Writer<FlatAccess>(FlatAccess{&tree}, multiLine)
+        .write(tree.root());
   }
 
  private:
-  struct Serialized {
-    std::string s;
-    bool terminal;
+  static const char* spelling(Unary::Operator op) {
+    switch (op) {
+      case Unary::MINUS:
+        return "-";
+      case Unary::BANG:
+        return "!";
+    }
+    return "";
+  }
+  static const char* spelling(Binary::Operator op) {
+    switch (op) {
+      case Binary::MINUS:
+        return "-";
+      case Binary::PLUS:
+        return "+";
+      case Binary::SLASH:
+        return "/";
+      case Binary::STAR:
+        return "*";
+      case Binary::BANG_EQUAL:
+        return "!=";
+      case Binary::EQUAL_EQUAL:
+        return "==";
+      case Binary::GREATER:
+        return ">";
+      case Binary::GREATER_EQUAL:
+        return ">=";
+      case Binary::LESS:
+        return "<";
+      case Binary::LESS_EQUAL:
+        return "<=";
+    }
+    return "";
+  }
+  static void number(double val, std::string* out) {
+    fmt::format_to(std::back_inserter(*out), "{}", val);
+  }
+  static void string(Symbol val, std::string* out) {
+    *out += '\'';
+    *out += val.str();
+    *out += '\'';
+  }
+  static void boolean(bool val, std::string* out) {
+    *out += val ? "true" : "false";
+  }
+
+  // Reads the nodes of a Tree for Writer.
+  struct NodeAccess {
+    using Ref = const Node*;
+    static bool literal(Ref node) {
+      return node->kind != Node::Kind::UNARY &&
+             node->kind != Node::Kind::BINARY;
+    }
+    static void writeLiteral(Ref node, std::string* out) {
+      switch (node->kind) {
+        case Node::Kind::NUMBER:
+          return number(static_cast<const Number*>(node)->val, out);
+        case Node::Kind::STRING:
+          return string(static_cast<const String*>(node)->val, out);
+        case Node::Kind::BOOL:
+          return boolean(static_cast<const Bool*>(node)->val, out);
+        default:
+          *out += "nil";
+      }
+    }
+    static bool unary(Ref node) { return node->kind == Node::Kind::UNARY; }
+    static const char* spelling(Ref node) {
+      if (unary(node)) {
+        return Printer::spelling(static_cast<const Unary*>(node)->op);
+      }
+      return Printer::spelling(static_cast<const Binary*>(node)->op);
+    }
+    static Ref operand(Ref node) {
+      return static_cast<const Unary*>(node)->operand;
+    }
+    static Ref first(Ref node) {
+      return static_cast<const Binary*>(node)->first;
+    }
+    static Ref second(Ref node) {
+      return static_cast<const Binary*>(node)->second;
+    }
   };
-  struct PrintVisitor : public Visitor {
-    PrintVisitor(bool multiLine = false) : multiLine_(multiLine) {}
-    std::any visitNumber(const Number* obj) override {
-      return Serialized{fmt::format("{}", obj->val), true};
-    }
-    std::any visitString(const String* obj) override {
-      return Serialized{fmt::format("'{}'", obj->val), true};
-    }
-    std::any visitBool(const Bool* obj) override {
-      const char* val = obj->val ? "true" : "false";
-      return Serialized{fmt::format("{}", val), true};
-    }
-    std::any visitNil(const Nil*) override { return Serialized{"nil", true}; }
-    std::any visitUnary(const Unary* obj) override {
-      indent_ += 2;
-      auto operandAny = obj->operand->accept(this);
-      indent_ -= 2;
-      auto* operand = std::any_cast<Serialized>(&operandAny);
-      const char* op = "";
-      switch (obj->op) {
-        case Unary::MINUS:
-          op = "-";
-          break;
-        case Unary::BANG:
-          op = "!";
-          break;
+
+  // Reads the nodes of a FlatTree for Writer.
+  struct FlatAccess {
+    using Ref = FlatTree::Index;
+    bool literal(Ref i) const {
+      return tree->kind(i) != FlatTree::Kind::UNARY &&
+             tree->kind(i) != FlatTree::Kind::BINARY;
+    }
+    void writeLiteral(Ref i, std::string* out) const {
+      switch (tree->kind(i)) {
+        case FlatTree::Kind::NUMBER:
+          return number(tree->number(i), out);
+        case FlatTree::Kind::STRING:
+          return string(tree->string(i), out);
+        case FlatTree::Kind::BOOL:
+          return boolean(tree->boolean(i), out);
+        default:
+          *out += "nil";
       }
-      std::stringstream ss;
-      if (not multiLine_ || operand->terminal) {
-        ss << "(" << op << " " << operand->s << ")";
-      } else {
-        ss << "(" << op << "\n"
-           << indent() << "  " << operand->s << "\n"
-           << indent() << ")";
+    }
+    bool unary(Ref i) const {
+      return tree->kind(i) == FlatTree::Kind::UNARY;
+    }
+    const char* spelling(Ref i) const {
+      return unary(i) ? Printer::spelling(tree->unaryOp(i))
+                      : Printer::spelling(tree->binaryOp(i));
+    }
+    Ref operand(Ref i) const { return tree->operand(i); }
+    Ref first(Ref i) const { return tree->first(i); }
+    Ref second(Ref i) const { return tree->second(i); }
+
+    const FlatTree* tree;
+  };
+
+  // Writes a tree in pre-order into one string, with an explicit stack
+  // since parsed trees can be far deeper than the native stack allows
+  // recursing. Operands are printed two spaces deeper than their operator;
+  // in multi-line mode an operator with a non-literal operand puts each
+  // operand on a line of its own.
+  template <typename Access>
+  class Writer {
+   public:
+    using Ref = typename Access::Ref;
+
+    Writer(Access access, bool multiLine)
+        : access_(access), multiLine_(multiLine) {}
+
+    std::string write(Ref root) {
+      pending_.push_back({root, nullptr, 0});
+      while (not pending_.empty()) {
+        const Pending p = pending_.back();
+        pending_.pop_back();
+        if (not p.text) {
+          node(p.ref, p.pad);
+          continue;
+        }
+        out_ += p.text;
+        if (p.pad >= 0) newline(p.pad);
+      }
+      return std::move(out_);
+    }
+
+   private:
+    // Either the node @ref, printed at indent @pad, or @text followed by a
+    // line break and @pad spaces unless @pad is negative.
+    struct Pending {
+      Ref ref;
+      const char* text;
+      int pad;
+    };
+
+    void node(Ref ref, int indent) {
+      if (access_.literal(ref)) {
+        access_.writeLiteral(ref, &out_);
+        return;
       }
-      return Serialized{ss.str(), false};
-    }
-    std::any visitBinary(const Binary* obj) override {
-      indent_ += 2;
-      auto firstAny = obj->first->accept(this);
-      auto secondAny = obj->second->accept(this);
-      indent_ -= 2;
-      auto* first = std::any_cast<Serialized>(&firstAny);
-      auto* second = std::any_cast<Serialized>(&secondAny);
-      const char* op = "";
-      switch (obj->op) {
-        case Binary::MINUS:
-          op = "-";
-          break;
-        case Binary::PLUS:
-          op = "+";
-          break;
-        case Binary::SLASH:
-          op = "/";
-          break;
-        case Binary::STAR:
-          op = "*";
-          break;
-        case Binary::BANG_EQUAL:
-          op = "!=";
-          break;
-        case Binary::EQUAL_EQUAL:
-          op = "==";
-          break;
-        case Binary::GREATER:
-          op = ">";
-          break;
-        case Binary::GREATER_EQUAL:
-          op = ">=";
-          break;
-        case Binary::LESS:
-          op = "<";
-          break;
-        case Binary::LESS_EQUAL:
-          op = "<=";
-          break;
+      const bool unary = access_.unary(ref);
+      out_ += '(';
+      out_ += access_.spelling(ref);
+      // Pushed in reverse, as the last piece is written first.
+      const int pad = indent + 2;
+      if (not multiLine_ ||
+          (unary ? access_.literal(access_.operand(ref))
+                 : access_.literal(access_.first(ref)) &&
+                       access_.literal(access_.second(ref)))) {
+        out_ += ' ';
+        text(")", -1);
+        if (unary) {
+          operand(access_.operand(ref), pad);
+        } else {
+          operand(access_.second(ref), pad);
+          text(", ", -1);
+          operand(access_.first(ref), pad);
+        }
+        return;
       }
-      std::stringstream ss;
-      if (not multiLine_ || (first->terminal && second->terminal)) {
-        ss << "(" << op << " " << first->s << ", " << second->s << ")";
+      newline(pad);
+      text(")", -1);
+      text("", indent);
+      if (unary) {
+        operand(access_.operand(ref), pad);
       } else {
-        ss << "(" << op << "\n"
-           << indent() << "  " << first->s << ",\n"
-           << indent() << "  " << second->s << "\n"
-           << indent() << ")";
+        operand(access_.second(ref), pad);
+        text(",", pad);
+        operand(access_.first(ref), pad);
       }
-      return Serialized{ss.str(), false};
     }
-    std::string indent() const { return std::string(indent_, ' '); }
-    bool multiLine_ = false;
-    int indent_ = 0;
+    void operand(Ref ref, int indent) {
+      pending_.push_back({ref, nullptr, indent});
+    }
+    void text(const char* text, int pad) {
+      pending_.push_back({Ref(), text, pad});
+    }
+    void newline(int pad) {
+      out_ += '\n';
+      out_.append(pad, ' ');
+    }
+
+    Access access_;
+    const bool multiLine_;
+    std::vector<Pending> pending_;
+    std::string out_;
   };
 };
 
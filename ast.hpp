@@ -1,7 +1,13 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "intern.hpp"
 #include "token.hpp"
 
 namespace lox {
@@ -9,32 +15,45 @@ namespace ast {
 
 class Visitor;
 
+// Nodes are allocated in the Arena owned by the Tree they belong to and are
+// never destroyed individually. They must therefore stay trivially
+// destructible: no owning members and no user-declared destructor.
+//
+// Every node records its concrete type in @kind, which lets TypedVisitor
+// dispatch without a virtual call.
 struct Node {
-  virtual ~Node() {}
+  enum class Kind : uint8_t { NUMBER, STRING, BOOL, NIL, UNARY, BINARY };
+  explicit Node(Kind k) : kind(k) {}
   virtual std::any accept(Visitor* visitor) const = 0;
+  const Kind kind;
 };
 
 struct Number : public Node {
+  Number() : Node(Kind::NUMBER) {}
   std::any accept(Visitor* visitor) const override;
   double val;
 };
 
 struct String : public Node {
+  String() : Node(Kind::STRING) {}
   std::any accept(Visitor* visitor) const override;
-  std::string val;
+  Symbol val;
 };
 
 struct Bool : public Node {
+  Bool() : Node(Kind::BOOL) {}
   std::any accept(Visitor* visitor) const override;
   bool val;
 };
 
 struct Nil : public Node {
+  Nil() : Node(Kind::NIL) {}
   std::any accept(Visitor* visitor) const override;
 };
 
 struct Unary : public Node {
   enum Operator { MINUS, BANG };
+  Unary() : Node(Kind::UNARY) {}
   std::any accept(Visitor* visitor) const override;
   Operator op;
   Token opToken;
@@ -42,7 +61,7 @@ struct Unary : public Node {
   // defined a separate Expr class yet because our current goal is to only
   // parse expressions. So expressions are actually the highest point in our
   // AST heirarchy.
-  std::unique_ptr<Node> operand;
+  const Node* operand;
 };
 
 struct Binary : public Node {
@@ -58,11 +77,12 @@ struct Binary : public Node {
     LESS,
     LESS_EQUAL
   };
+  Binary() : Node(Kind::BINARY) {}
   std::any accept(Visitor* visitor) const override;
   Operator op;
   Token opToken;
-  std::unique_ptr<Node> first;
-  std::unique_ptr<Node> second;
+  const Node* first;
+  const Node* second;
 };
 
 class Visitor {
@@ -76,12 +96,135 @@ class Visitor {
   virtual std::any visitBinary(const Binary* binary) = 0;
 };
 
-std::any Number::accept(Visitor* v) const { return v->visitNumber(this); }
-std::any String::accept(Visitor* v) const { return v->visitString(this); }
-std::any Bool::accept(Visitor* v) const { return v->visitBool(this); }
-std::any Nil::accept(Visitor* v) const { return v->visitNil(this); }
-std::any Unary::accept(Visitor* v) const { return v->visitUnary(this); }
-std::any Binary::accept(Visitor* v) const { return v->visitBinary(this); }
+// Statically typed visitor. Derived classes implement the visit methods
+// below as plain (non-virtual) members returning R, and call visit() on
+// children:
+//   struct Depth : TypedVisitor<Depth, int> {
+//     int visitNumber(const Number*) { return 1; }
+//     ...
+//   };
+// Dispatch is a switch on Node::kind, so results are returned by value
+// without type erasure and the calls can be inlined.
+template <typename Derived, typename R> class TypedVisitor {
+ public:
+  R visit(const Node* node) {
+    auto* self = static_cast<Derived*>(this);
+    switch (node->kind) {
+      case Node::Kind::NUMBER:
+        return self->visitNumber(static_cast<const Number*>(node));
+      case Node::Kind::STRING:
+        return self->visitString(static_cast<const String*>(node));
+      case Node::Kind::BOOL:
+        return self->visitBool(static_cast<const Bool*>(node));
+      case Node::Kind::NIL:
+        return self->visitNil(static_cast<const Nil*>(node));
+      case Node::Kind::UNARY:
+        return self->visitUnary(static_cast<const Unary*>(node));
+      case Node::Kind::BINARY:
+        return self->visitBinary(static_cast<const Binary*>(node));
+    }
+    __builtin_unreachable();
+  }
+};
+
+// The parsed form of a program: a root node together with the arena that owns
+// every node reachable from it. Releasing the tree frees all nodes at once,
+// without walking them.
+class Tree {
+ public:
+  Tree() = default;
+  Tree(std::unique_ptr<Arena> arena, const Node* root)
+    : arena_(std::move(arena)), root_(root) {}
+  const Node* get() const { return root_; }
+  const Node* operator->() const { return root_; }
+  explicit operator bool() const { return root_ != nullptr; }
+  Arena* arena() const { return arena_.get(); }
+  // Replaces the root, e.g. with a rewritten tree whose new nodes were
+  // allocated in arena().
+  void setRoot(const Node* root) { root_ = root; }
+  // Adds a string for String nodes to refer to that was made after parsing,
+  // e.g. by constant folding. Unlike interned strings, it is not kept for
+  // the life of the process but released with the tree.
+  Symbol addString(std::string s) {
+    strings_.push_back(std::make_unique<StringObj>(std::move(s)));
+    StringObj* obj = strings_.back().get();
+    obj->immortal = true;
+    stringBytes_ += sizeof(StringObj) + obj->str.capacity();
+    return Symbol::unpooled(obj);
+  }
+  // Bytes held by the strings added with addString().
+  size_t stringBytes() const { return stringBytes_; }
+
+ private:
+  std::unique_ptr<Arena> arena_;
+  const Node* root_ = nullptr;
+  std::vector<std::unique_ptr<StringObj>> strings_;
+  size_t stringBytes_ = 0;
+};
+
+// Parser builder that allocates a pointer-linked Tree in an arena.
+class TreeBuilder {
+ public:
+  using Ref = Node*;
+  using Result = Tree;
+
+  TreeBuilder() : arena_(std::make_unique<Arena>()) {}
+  Ref number(double val) {
+    auto* number = arena_->make<Number>();
+    number->val = val;
+    return number;
+  }
+  Ref string(Symbol val) {
+    auto* str = arena_->make<String>();
+    str->val = val;
+    return str;
+  }
+  Ref boolean(bool val) {
+    auto* boolean = arena_->make<Bool>();
+    boolean->val = val;
+    return boolean;
+  }
+  Ref nil() { return arena_->make<Nil>(); }
+  Ref unary(Unary::Operator op, const Token& token, Ref operand) {
+    auto* unary = arena_->make<Unary>();
+    unary->op = op;
+    unary->opToken = token;
+    unary->operand = operand;
+    return unary;
+  }
+  Ref binary(Binary::Operator op, const Token& token, Ref first,
+             Ref second) {
+    auto* binary = arena_->make<Binary>();
+    binary->op = op;
+    binary->opToken = token;
+    binary->first = first;
+    binary->second = second;
+    return binary;
+  }
+  Result finish(Ref root) { return Tree(std::move(arena_), root); }
+
+ private:
+  std::unique_ptr<Arena> arena_;
+};
+
+inline std::any Number::accept(Visitor* v) const {
+  return v->visitNumber(this);
+}
+inline std::any String::accept(Visitor* v) const {
+  return v->visitString(this);
+}
+inline std::any Bool::accept(Visitor* v) const {
+  return v->visitBool(this);
+}
+inline std::any Nil::accept(Visitor* v) const {
+  return v->visitNil(this);
+}
+inline std::any Unary::accept(Visitor* v) const {
+  return v->visitUnary(this);
+}
+inline std::any Binary::accept(Visitor* v) const {
+  return v->visitBinary(this);
+}
 
 }  // namespace ast
 }  // namespace lox
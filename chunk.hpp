@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "value.hpp"
+
+namespace lox {
+namespace vm {
+
+// Instruction set of the bytecode VM. Every instruction is a single opcode
+// byte, optionally followed by inline operands.
+enum class OpCode : uint8_t {
+  CONSTANT,       // [idx:u8]  push constants[idx]
+  CONSTANT_LONG,  // [idx:u24] push constants[idx] (little endian)
+  NIL,
+  TRUE,
+  FALSE,
+  NEGATE,
+  NOT,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  RETURN
+};
+
+// A Chunk is a compiled unit of bytecode: the instruction stream, the
+// constant pool it refers to and, for every byte of code, the source
+// location that runtime errors should be reported against.
+class Chunk {
+ public:
+  void write(OpCode op, int location) {
+    writeByte(static_cast<uint8_t>(op), location);
+  }
+  void writeByte(uint8_t byte, int location) {
+    code_.push_back(byte);
+    locations_.push_back(location);
+  }
+  // Appends an instruction pushing @v, picking the short form of the
+  // instruction when the constant index fits in a byte.
+  void writeConstant(const ast::Value& v, int location) {
+    const size_t idx = constants_.size();
+    constants_.push_back(v);
+    if (idx <= 0xff) {
+      write(OpCode::CONSTANT, location);
+      writeByte(idx, location);
+    } else {
+      write(OpCode::CONSTANT_LONG, location);
+      writeByte(idx & 0xff, location);
+      writeByte((idx >> 8) & 0xff, location);
+      writeByte((idx >> 16) & 0xff, location);
+    }
+  }
+
+  const uint8_t* code() const { return code_.data(); }
+  size_t size() const { return code_.size(); }
+  const ast::Value& constant(size_t idx) const { return constants_[idx]; }
+  int location(size_t offset) const { return locations_[offset]; }
+  // Upper bound on the operand stack depth needed to run this chunk.
+  int maxStack() const { return maxStack_; }
+  void setMaxStack(int maxStack) { maxStack_ = maxStack; }
+
+ private:
+  std::vector<uint8_t> code_;
+  std::vector<int> locations_;
+  std::vector<ast::Value> constants_;
+  int maxStack_ = 0;
+};
+
+}  // namespace vm
+}  // namespace lox
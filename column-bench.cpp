@@ -0,0 +1,137 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ast-eval.hpp"
+#include "column.hpp"
+#include "error-reporter.hpp"
+#include "parser.hpp"
+#include "simd-scan.hpp"
+
+namespace lox {
+namespace {
+
+constexpr size_t kRows = 1 << 20;
+const char kNumberExpr[] = "price * qty - discount / 2";
+const char kBoolExpr[] = "price * qty - discount / 2 > 100 == !member";
+
+struct Columns {
+  std::vector<double> price, qty, discount;
+  column::Bitmap member{kRows};
+};
+
+const Columns& columns() {
+  static const Columns c = [] {
+    Columns c;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> value(0, 50);
+    for (size_t i = 0; i < kRows; ++i) {
+      c.price.push_back(value(rng));
+      c.qty.push_back(value(rng));
+      c.discount.push_back(value(rng));
+      c.member.set(i, value(rng) < 10);
+    }
+    return c;
+  }();
+  return c;
+}
+
+const std::vector<column::Input> kInputs = {
+    {"price", column::Type::NUMBER},
+    {"qty", column::Type::NUMBER},
+    {"discount", column::Type::NUMBER},
+    {"member", column::Type::BOOL}};
+
+// Builds an ordinary tree in which every input is a literal whose value is
+// patched before each row, which is how the tree-walker would evaluate the
+// expression row at a time.
+class RowBuilder : public ast::TreeBuilder {
+ public:
+  struct Patch {
+    size_t input;
+    Ref node;
+  };
+
+  Ref identifier(const Token& token) {
+    size_t i = 0;
+    while (kInputs[i].name != token.lexeme()) ++i;
+    const Ref node =
+        kInputs[i].type == column::Type::BOOL ? boolean(false) : number(0);
+    patches.push_back({i, node});
+    return node;
+  }
+
+  std::vector<Patch> patches;
+};
+
+// Args: {bool result}.
+void BM_EvalRows(benchmark::State& state) {
+  const std::string expr = state.range(0) ? kBoolExpr : kNumberExpr;
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  RowBuilder builder;
+  const ast::Tree tree = parser.parseWith(&builder);
+  const Columns& c = columns();
+  const std::vector<double>* numbers[] = {&c.price, &c.qty, &c.discount};
+  for (auto _ : state) {
+    for (size_t row = 0; row < kRows; ++row) {
+      for (const RowBuilder::Patch& patch : builder.patches) {
+        if (kInputs[patch.input].type == column::Type::BOOL) {
+          static_cast<ast::Bool*>(patch.node)->val = c.member.test(row);
+        } else {
+          static_cast<ast::Number*>(patch.node)->val =
+              (*numbers[patch.input])[row];
+        }
+      }
+      ast::Value value;
+      ast::Evaluator::eval(tree.get(), &value);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kRows);
+}
+
+// Args: {bool result, batch size, simd::Level}.
+void BM_EvalColumns(benchmark::State& state) {
+  const std::string expr = state.range(0) ? kBoolExpr : kNumberExpr;
+  ErrorReporter err(expr);
+  column::Program program;
+  if (not program.compile(expr, kInputs, &err)) {
+    state.SkipWithError("compile failed");
+    return;
+  }
+  program.setBatchSize(state.range(1));
+  program.setLevel(static_cast<simd::Level>(state.range(2)));
+  const Columns& c = columns();
+  std::vector<double> numbers;
+  column::Bitmap bools;
+  for (auto _ : state) {
+    if (state.range(0)) {
+      program.eval({c.price, c.qty, c.discount, c.member}, &bools);
+    } else {
+      program.eval({c.price, c.qty, c.discount, c.member}, &numbers);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * kRows);
+}
+
+void columnArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"bool", "batch", "level"});
+  for (int result = 0; result < 2; ++result) {
+    for (int batch : {1024, 4096}) {
+      b->Args({result, batch, static_cast<int>(simd::Level::GENERIC)});
+      b->Args({result, batch, static_cast<int>(simd::Level::AVX2)});
+    }
+  }
+}
+
+BENCHMARK(BM_EvalRows)->ArgName("bool")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EvalColumns)->Apply(columnArgs)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace lox
+
+BENCHMARK_MAIN();
@@ -0,0 +1,455 @@
+#include "column.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+#include "ast-eval.hpp"
+#include "parser.hpp"
+#include "value.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOX_COLUMN_X86 1
+#endif
+
+namespace lox {
+namespace column {
+
+namespace {
+
+// Kernels over one batch of @n rows. Comparisons write ceil(@n / 64) words;
+// bits past @n in the last word are unspecified.
+struct Kernels {
+  void (*arith[4])(const double* a, const double* b, double* out, size_t n);
+  void (*negate)(const double* a, double* out, size_t n);
+  void (*compare[6])(const double* a, const double* b, uint64_t* out,
+                     size_t n);
+};
+
+// Index of the arith and compare kernels for an instruction.
+size_t arithIndex(uint8_t op) { return op - 1; }   // from ADD.
+size_t compareIndex(uint8_t op) { return op - 5; }  // from EQUAL.
+
+namespace generic {
+
+template <typename F>
+void arith(const double* a, const double* b, double* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) out[i] = F()(a[i], b[i]);
+}
+void negate(const double* a, double* out, size_t n) {
+  for (size_t i = 0; i < n; ++i) out[i] = -a[i];
+}
+template <typename F>
+void compare(const double* a, const double* b, uint64_t* out, size_t n) {
+  for (size_t w = 0; w * 64 < n; ++w) {
+    const size_t base = w * 64;
+    const size_t rows = std::min<size_t>(64, n - base);
+    uint64_t word = 0;
+    for (size_t j = 0; j < rows; ++j) {
+      word |= uint64_t{F()(a[base + j], b[base + j])} << j;
+    }
+    out[w] = word;
+  }
+}
+
+constexpr Kernels kKernels = {
+    {arith<std::plus<double>>, arith<std::minus<double>>,
+     arith<std::multiplies<double>>, arith<std::divides<double>>},
+    negate,
+    {compare<std::equal_to<double>>, compare<std::not_equal_to<double>>,
+     compare<std::greater<double>>, compare<std::greater_equal<double>>,
+     compare<std::less<double>>, compare<std::less_equal<double>>}};
+
+}  // namespace generic
+
+#ifdef LOX_COLUMN_X86
+
+#define LOX_AVX2 __attribute__((target("avx2")))
+
+namespace avx2 {
+
+enum ArithOp { ADD, SUB, MUL, DIV };
+
+template <ArithOp kOp> LOX_AVX2 __m256d apply(__m256d a, __m256d b) {
+  switch (kOp) {
+    case ADD: return _mm256_add_pd(a, b);
+    case SUB: return _mm256_sub_pd(a, b);
+    case MUL: return _mm256_mul_pd(a, b);
+    case DIV: return _mm256_div_pd(a, b);
+  }
+  return a;
+}
+
+// Two vectors per iteration, so that independent operations overlap.
+template <ArithOp kOp, typename F>
+LOX_AVX2 void arith(const double* a, const double* b, double* out,
+                    size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256d x0 = apply<kOp>(_mm256_loadu_pd(a + i),
+                                  _mm256_loadu_pd(b + i));
+    const __m256d x1 = apply<kOp>(_mm256_loadu_pd(a + i + 4),
+                                  _mm256_loadu_pd(b + i + 4));
+    _mm256_storeu_pd(out + i, x0);
+    _mm256_storeu_pd(out + i + 4, x1);
+  }
+  generic::arith<F>(a + i, b + i, out + i, n - i);
+}
+
+LOX_AVX2 void negate(const double* a, double* out, size_t n) {
+  const __m256d sign = _mm256_set1_pd(-0.0);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(a + i), sign));
+  }
+  generic::negate(a + i, out + i, n - i);
+}
+
+// Predicates are the ordered, non-signaling ones, except for '!=', so that
+// NaNs compare like they do in C++ and hence in the Evaluator.
+template <int kPredicate, typename F>
+LOX_AVX2 void compare(const double* a, const double* b, uint64_t* out,
+                      size_t n) {
+  size_t w = 0;
+  for (; (w + 1) * 64 <= n; ++w) {
+    const double* pa = a + w * 64;
+    const double* pb = b + w * 64;
+    uint64_t word = 0;
+    for (int j = 0; j < 64; j += 4) {
+      const __m256d m = _mm256_cmp_pd(_mm256_loadu_pd(pa + j),
+                                      _mm256_loadu_pd(pb + j), kPredicate);
+      word |= uint64_t(_mm256_movemask_pd(m)) << j;
+    }
+    out[w] = word;
+  }
+  generic::compare<F>(a + w * 64, b + w * 64, out + w, n - w * 64);
+}
+
+constexpr Kernels kKernels = {
+    {arith<ADD, std::plus<double>>, arith<SUB, std::minus<double>>,
+     arith<MUL, std::multiplies<double>>, arith<DIV, std::divides<double>>},
+    negate,
+    {compare<_CMP_EQ_OQ, std::equal_to<double>>,
+     compare<_CMP_NEQ_UQ, std::not_equal_to<double>>,
+     compare<_CMP_GT_OQ, std::greater<double>>,
+     compare<_CMP_GE_OQ, std::greater_equal<double>>,
+     compare<_CMP_LT_OQ, std::less<double>>,
+     compare<_CMP_LE_OQ, std::less_equal<double>>}};
+
+}  // namespace avx2
+
+#endif  // LOX_COLUMN_X86
+
+const Kernels& kernelsFor(simd::Level level) {
+#ifdef LOX_COLUMN_X86
+  if (level == simd::Level::AVX2 &&
+      simd::detectLevel() == simd::Level::AVX2) {
+    return avx2::kKernels;
+  }
+#else
+  (void)level;
+#endif
+  return generic::kKernels;
+}
+
+}  // namespace
+
+// Parser builder that type checks the expression and lowers it into
+// column instructions. Every Ref is a slot. Subexpressions whose operands
+// are all constant are folded, and values that are only ever used once,
+// as in any tree, let temporaries be recycled as soon as they are read.
+class Builder {
+ public:
+  using Ref = uint32_t;
+  using Result = bool;
+
+  Builder(Program* program, const std::vector<Input>& inputs)
+    : p_(program), inputs_(inputs) {}
+
+  Ref number(double val) { return constant(ast::Value(val)); }
+  Ref string(Symbol val) { return constant(ast::Value(val)); }
+  Ref boolean(bool val) { return constant(ast::Value(val)); }
+  Ref nil() { return constant(ast::Value::Nil()); }
+  Ref identifier(const Token& token) {
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      if (inputs_[i].name == token.lexeme()) {
+        Program::Slot slot{Program::Slot::INPUT, inputs_[i].type};
+        slot.index = i;
+        return add(slot, ast::Value());
+      }
+    }
+    throw ErrorReporter::Error{
+        token.location(),
+        fmt::format("Undefined input: {}", token.lexeme())};
+  }
+  Ref unary(ast::Unary::Operator op, const Token& token, Ref operand) {
+    ast::Value result;
+    const char* error = ast::Evaluator::unary(op, sample(operand), &result);
+    if (error) throw ErrorReporter::Error{token.location(), error};
+    if (isConstant(operand)) return constant(result);
+    if (op == ast::Unary::MINUS) return emit(Program::Op::NEGATE, operand);
+    // Numbers are always truthy.
+    if (type(operand) == Type::NUMBER) return constant(ast::Value(false));
+    return emit(Program::Op::NOT, operand);
+  }
+  Ref binary(ast::Binary::Operator op, const Token& token, Ref first,
+             Ref second) {
+    ast::Value result;
+    const char* error =
+        ast::Evaluator::binary(op, sample(first), sample(second), &result);
+    if (error) throw ErrorReporter::Error{token.location(), error};
+    if (isConstant(first) && isConstant(second)) return constant(result);
+    const bool equality = op == ast::Binary::EQUAL_EQUAL ||
+                          op == ast::Binary::BANG_EQUAL;
+    // Values of different types are never equal.
+    if (equality && sample(first).type() != sample(second).type()) {
+      return constant(ast::Value(op == ast::Binary::BANG_EQUAL));
+    }
+    if (equality && type(first) == Type::BOOL) {
+      return emit(op == ast::Binary::EQUAL_EQUAL
+                      ? Program::Op::BOOL_EQUAL
+                      : Program::Op::BOOL_NOT_EQUAL,
+                  first, second);
+    }
+    switch (op) {
+      case ast::Binary::MINUS:
+        return emit(Program::Op::SUBTRACT, first, second);
+      case ast::Binary::PLUS:
+        return emit(Program::Op::ADD, first, second);
+      case ast::Binary::SLASH:
+        return emit(Program::Op::DIVIDE, first, second);
+      case ast::Binary::STAR:
+        return emit(Program::Op::MULTIPLY, first, second);
+      case ast::Binary::BANG_EQUAL:
+        return emit(Program::Op::NOT_EQUAL, first, second);
+      case ast::Binary::EQUAL_EQUAL:
+        return emit(Program::Op::EQUAL, first, second);
+      case ast::Binary::GREATER:
+        return emit(Program::Op::GREATER, first, second);
+      case ast::Binary::GREATER_EQUAL:
+        return emit(Program::Op::GREATER_EQUAL, first, second);
+      case ast::Binary::LESS:
+        return emit(Program::Op::LESS, first, second);
+      case ast::Binary::LESS_EQUAL:
+        return emit(Program::Op::LESS_EQUAL, first, second);
+    }
+    throw ErrorReporter::Error{token.location(), "Unexpected operator"};
+  }
+  Result finish(Ref root) {
+    const ast::ValueType t = sample(root).type();
+    if (t != ast::ValueType::NUMBER && t != ast::ValueType::BOOL) {
+      throw ErrorReporter::Error{
+          0, "Columnar expressions must evaluate to a number or a bool"};
+    }
+    p_->result_ = root;
+    p_->type_ = type(root);
+    return true;
+  }
+
+ private:
+  // Constant value of a slot, or a value of its type otherwise. Type
+  // checking evaluates operators on these, which yields the Evaluator's
+  // errors and result types.
+  const ast::Value& sample(Ref ref) const { return samples_[ref]; }
+  bool isConstant(Ref ref) const {
+    return p_->slots_[ref].kind == Program::Slot::CONSTANT;
+  }
+  Type type(Ref ref) const { return p_->slots_[ref].type; }
+
+  Ref constant(const ast::Value& value) {
+    Program::Slot slot{Program::Slot::CONSTANT, Type::NUMBER};
+    if (value.type() == ast::ValueType::NUMBER) {
+      slot.number = value.d();
+    } else if (value.type() == ast::ValueType::BOOL) {
+      slot.type = Type::BOOL;
+      slot.boolean = value.b();
+    }
+    // Constants of other types only ever meet constants or equality, so
+    // they are folded away before reaching an instruction.
+    return add(slot, value);
+  }
+  Ref add(const Program::Slot& slot, const ast::Value& constant) {
+    p_->slots_.push_back(slot);
+    if (slot.kind == Program::Slot::CONSTANT) {
+      samples_.push_back(constant);
+    } else {
+      samples_.push_back(slot.type == Type::NUMBER ? ast::Value(0.0)
+                                                   : ast::Value(false));
+    }
+    return p_->slots_.size() - 1;
+  }
+  Ref emit(Program::Op op, Ref a, Ref b = 0) {
+    release(a);
+    if (b != a) release(b);
+    const bool numeric = op == Program::Op::NEGATE ||
+                         (op >= Program::Op::ADD &&
+                          op <= Program::Op::DIVIDE);
+    Program::Slot slot{Program::Slot::TEMP,
+                       numeric ? Type::NUMBER : Type::BOOL};
+    std::vector<uint32_t>& free = numeric ? freeNumbers_ : freeBools_;
+    if (not free.empty()) {
+      slot.index = free.back();
+      free.pop_back();
+    } else {
+      slot.index = numeric ? p_->numberTemps_++ : p_->boolTemps_++;
+    }
+    const Ref dst = add(slot, ast::Value());
+    p_->code_.push_back({op, dst, a, b});
+    return dst;
+  }
+  // Makes the temporary of @ref available again. Kernels are elementwise,
+  // so an instruction may write to a temporary it reads.
+  void release(Ref ref) {
+    const Program::Slot& slot = p_->slots_[ref];
+    if (slot.kind != Program::Slot::TEMP) return;
+    (slot.type == Type::NUMBER ? freeNumbers_ : freeBools_)
+        .push_back(slot.index);
+  }
+
+  Program* p_;
+  const std::vector<Input>& inputs_;
+  std::vector<ast::Value> samples_;  // per slot.
+  std::vector<uint32_t> freeNumbers_;
+  std::vector<uint32_t> freeBools_;
+};
+
+size_t Bitmap::count() const {
+  size_t n = 0;
+  for (uint64_t word : words_) n += __builtin_popcountll(word);
+  return n;
+}
+
+bool Program::compile(std::string_view source,
+                      const std::vector<Input>& inputs, ErrorReporter* err) {
+  *this = Program();
+  inputs_ = inputs;
+  Builder builder(this, inputs_);
+  Parser parser(err, source.data(), source.data() + source.size());
+  return parser.parseWith(&builder);
+}
+
+bool Program::checkColumns(const std::vector<ColumnRef>& columns,
+                           Type type) const {
+  if (type != type_ || columns.size() != inputs_.size() ||
+      batchSize_ == 0 || batchSize_ % 64 != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < columns.size(); ++i) {
+    if (columns[i].type != inputs_[i].type ||
+        columns[i].size() != columns[0].size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename F>
+void Program::run(const std::vector<ColumnRef>& columns, F&& result) const {
+  const Kernels& k = kernelsFor(level_);
+  const size_t rows = columns.empty() ? 0 : columns[0].size();
+  const size_t words = batchSize_ / 64;
+  std::vector<double> numbers(numberTemps_ * batchSize_);
+  std::vector<uint64_t> bools(boolTemps_ * words);
+  // Constants are materialized once, as columns of a single value.
+  std::vector<std::vector<double>> numberConstants;
+  std::vector<std::vector<uint64_t>> boolConstants;
+  std::vector<const double*> numberData(slots_.size());
+  std::vector<const uint64_t*> boolData(slots_.size());
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const Slot& slot = slots_[i];
+    if (slot.kind == Slot::CONSTANT && slot.type == Type::NUMBER) {
+      numberConstants.emplace_back(batchSize_, slot.number);
+      numberData[i] = numberConstants.back().data();
+    } else if (slot.kind == Slot::CONSTANT) {
+      boolConstants.emplace_back(words, slot.boolean ? ~uint64_t{0} : 0);
+      boolData[i] = boolConstants.back().data();
+    } else if (slot.kind == Slot::TEMP && slot.type == Type::NUMBER) {
+      numberData[i] = numbers.data() + slot.index * batchSize_;
+    } else if (slot.kind == Slot::TEMP) {
+      boolData[i] = bools.data() + slot.index * words;
+    }
+  }
+  for (size_t row = 0; row < rows; row += batchSize_) {
+    const size_t n = std::min(batchSize_, rows - row);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      const Slot& slot = slots_[i];
+      if (slot.kind != Slot::INPUT) continue;
+      const ColumnRef& column = columns[slot.index];
+      if (slot.type == Type::NUMBER) {
+        numberData[i] = column.numbers.data() + row;
+      } else {
+        boolData[i] = column.bools->words() + row / 64;
+      }
+    }
+    for (const Instr& instr : code_) {
+      // Temporaries are the only slots instructions write to.
+      double* numberOut = const_cast<double*>(numberData[instr.dst]);
+      uint64_t* boolOut = const_cast<uint64_t*>(boolData[instr.dst]);
+      const uint8_t op = static_cast<uint8_t>(instr.op);
+      switch (instr.op) {
+        case Op::NEGATE:
+          k.negate(numberData[instr.a], numberOut, n);
+          break;
+        case Op::ADD:
+        case Op::SUBTRACT:
+        case Op::MULTIPLY:
+        case Op::DIVIDE:
+          k.arith[arithIndex(op)](numberData[instr.a], numberData[instr.b],
+                                  numberOut, n);
+          break;
+        case Op::EQUAL:
+        case Op::NOT_EQUAL:
+        case Op::GREATER:
+        case Op::GREATER_EQUAL:
+        case Op::LESS:
+        case Op::LESS_EQUAL:
+          k.compare[compareIndex(op)](numberData[instr.a],
+                                      numberData[instr.b], boolOut, n);
+          break;
+        case Op::NOT:
+          for (size_t w = 0; w * 64 < n; ++w) {
+            boolOut[w] = ~boolData[instr.a][w];
+          }
+          break;
+        case Op::BOOL_EQUAL:
+          for (size_t w = 0; w * 64 < n; ++w) {
+            boolOut[w] = ~(boolData[instr.a][w] ^ boolData[instr.b][w]);
+          }
+          break;
+        case Op::BOOL_NOT_EQUAL:
+          for (size_t w = 0; w * 64 < n; ++w) {
+            boolOut[w] = boolData[instr.a][w] ^ boolData[instr.b][w];
+          }
+          break;
+      }
+    }
+    result(row, n, numberData[result_], boolData[result_]);
+  }
+}
+
+bool Program::eval(const std::vector<ColumnRef>& columns,
+                   std::vector<double>* out) const {
+  if (not checkColumns(columns, Type::NUMBER)) return false;
+  out->resize(columns.empty() ? 0 : columns[0].size());
+  run(columns, [out](size_t row, size_t n, const double* data,
+                     const uint64_t*) {
+    std::memcpy(out->data() + row, data, n * sizeof(double));
+  });
+  return true;
+}
+
+bool Program::eval(const std::vector<ColumnRef>& columns,
+                   Bitmap* out) const {
+  if (not checkColumns(columns, Type::BOOL)) return false;
+  *out = Bitmap(columns.empty() ? 0 : columns[0].size());
+  run(columns, [out](size_t row, size_t n, const double*,
+                     const uint64_t* data) {
+    uint64_t* words = out->words() + row / 64;
+    std::memcpy(words, data, (n + 63) / 64 * sizeof(uint64_t));
+    if (n % 64 != 0) words[n / 64] &= (uint64_t{1} << (n % 64)) - 1;
+  });
+  return true;
+}
+
+}  // namespace column
+}  // namespace lox
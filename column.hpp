@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "error-reporter.hpp"
+#include "simd-scan.hpp"
+
+namespace lox {
+namespace column {
+
+// Read-only view of a contiguous array, standing in for C++20's std::span.
+template <typename T> class Span {
+ public:
+  Span() = default;
+  Span(const T* data, size_t size) : data_(data), size_(size) {}
+  Span(const std::vector<T>& v) : data_(v.data()), size_(v.size()) {}
+
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  const T& operator[](size_t i) const { return data_[i]; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Column of booleans, one bit per row: row i is bit i % 64 of word i / 64.
+// Bits past size() in the last word are always clear. Used both for bool
+// inputs and as the selection produced by boolean expressions.
+class Bitmap {
+ public:
+  Bitmap() = default;
+  explicit Bitmap(size_t size) : words_((size + 63) / 64), size_(size) {}
+
+  size_t size() const { return size_; }
+  bool test(size_t i) const { return words_[i / 64] >> (i % 64) & 1; }
+  void set(size_t i, bool value) {
+    const uint64_t bit = uint64_t{1} << (i % 64);
+    words_[i / 64] = value ? words_[i / 64] | bit : words_[i / 64] & ~bit;
+  }
+  // Number of rows set.
+  size_t count() const;
+  const uint64_t* words() const { return words_.data(); }
+  uint64_t* words() { return words_.data(); }
+
+ private:
+  std::vector<uint64_t> words_;
+  size_t size_ = 0;
+};
+
+enum class Type : uint8_t { NUMBER, BOOL };
+
+// A named input of a Program.
+struct Input {
+  std::string name;
+  Type type;
+};
+
+// Input column handed to Program::eval(): numbers for NUMBER inputs, or a
+// bitmap for BOOL inputs.
+struct ColumnRef {
+  ColumnRef(Span<double> numbers) : type(Type::NUMBER), numbers(numbers) {}
+  ColumnRef(const std::vector<double>& numbers)
+    : type(Type::NUMBER), numbers(numbers) {}
+  ColumnRef(const Bitmap& bools) : type(Type::BOOL), bools(&bools) {}
+  size_t size() const {
+    return type == Type::NUMBER ? numbers.size() : bools->size();
+  }
+
+  Type type;
+  Span<double> numbers;
+  const Bitmap* bools = nullptr;
+};
+
+// An expression compiled once and then evaluated over whole columns of
+// inputs, instead of once per row. Identifiers in the expression name the
+// inputs, so for inputs {"price", NUMBER} and {"qty", NUMBER}
+//   Program program;
+//   program.compile("price * qty > 100", inputs, &err);
+//   Bitmap selected;
+//   program.eval({prices, quantities}, &selected);
+// selects the rows whose product exceeds 100.
+//
+// Types are checked when compiling, with the Evaluator's rules and error
+// messages, so evaluation itself cannot fail. Numbers are computed in
+// double columns and booleans in bitmaps. Rows are processed in batches
+// small enough to keep every intermediate column in cache, and each
+// operator runs as one tight loop over a batch, vectorized with AVX2 when
+// the CPU has it.
+class Program {
+ public:
+  static constexpr size_t kDefaultBatchSize = 1024;
+
+  // Compiles @source against @inputs. Returns false and reports errors to
+  // @err if the source does not parse or does not type check.
+  bool compile(std::string_view source, const std::vector<Input>& inputs,
+               ErrorReporter* err);
+  // Type of the expression's value.
+  Type type() const { return type_; }
+
+  // Evaluates a NUMBER program over @columns, which hold one column for
+  // each input, in order, all of the same length. Returns false if the
+  // columns do not match the inputs.
+  bool eval(const std::vector<ColumnRef>& columns,
+            std::vector<double>* out) const;
+  // Same as above for BOOL programs, setting the selected rows in @out.
+  bool eval(const std::vector<ColumnRef>& columns, Bitmap* out) const;
+
+  // Rows per batch; a positive multiple of 64, by default 1024.
+  void setBatchSize(size_t rows) { batchSize_ = rows; }
+  // Instruction set to use, by default the best one the CPU supports.
+  void setLevel(simd::Level level) { level_ = level; }
+
+ private:
+  friend class Builder;
+
+  enum class Op : uint8_t {
+    NEGATE,
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    NOT,
+    BOOL_EQUAL,
+    BOOL_NOT_EQUAL,
+  };
+  // Operand or result of an instruction.
+  struct Slot {
+    enum Kind : uint8_t { INPUT, CONSTANT, TEMP };
+    Kind kind;
+    Type type;
+    uint32_t index = 0;    // input or temporary column, by type.
+    double number = 0;     // value of a NUMBER constant.
+    bool boolean = false;  // value of a BOOL constant.
+  };
+  // Computes slot @dst from slots @a and, for binary operators, @b.
+  struct Instr {
+    Op op;
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+  };
+
+  bool checkColumns(const std::vector<ColumnRef>& columns, Type type) const;
+  // Runs the program over all rows; @result is called with the result
+  // slot's data for every batch.
+  template <typename F>
+  void run(const std::vector<ColumnRef>& columns, F&& result) const;
+
+  std::vector<Input> inputs_;
+  std::vector<Slot> slots_;
+  std::vector<Instr> code_;
+  uint32_t numberTemps_ = 0;
+  uint32_t boolTemps_ = 0;
+  uint32_t result_ = 0;  // slot holding the value of the expression.
+  Type type_ = Type::NUMBER;
+  size_t batchSize_ = kDefaultBatchSize;
+  simd::Level level_ = simd::detectLevel();
+};
+
+}  // namespace column
+}  // namespace lox
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "chunk.hpp"
+#include "error-reporter.hpp"
+#include "value.hpp"
+
+namespace lox {
+namespace vm {
+
+// Lowers an expression tree into a bytecode Chunk for the VM. Operands are
+// emitted in the same order the tree-walking Evaluator visits them, so both
+// engines observe identical evaluation order and report the same errors.
+class Compiler {
+ public:
+  // Maximum number of entries in a chunk's constant pool.
+  static constexpr size_t kMaxConstants = 1 << 24;
+
+  static bool compile(const ast::Node* node, Chunk* chunk,
+                      ErrorReporter* err) {
+    Emitter emitter(chunk);
+    emitter.emitTree(node);
+    if (emitter.numConstants_ > kMaxConstants) {
+      err->report(0, "Too many constants in one chunk");
+      return false;
+    }
+    chunk->write(OpCode::RETURN, 0);
+    chunk->setMaxStack(emitter.maxDepth_);
+    return true;
+  }
+
+ private:
+  struct Emitter {
+    Emitter(Chunk* chunk) : chunk_(chunk) {}
+
+    // Emits @node in post-order with an explicit stack, since parsed trees
+    // can be far deeper than the native stack allows recursing. Only
+    // operators are pushed, with whether their second operand is emitted.
+    void emitTree(const ast::Node* node) {
+      std::vector<std::pair<const ast::Node*, bool>> stack;
+      while (true) {
+        while (node->kind == ast::Node::Kind::UNARY ||
+               node->kind == ast::Node::Kind::BINARY) {
+          stack.push_back({node, false});
+          node = node->kind == ast::Node::Kind::UNARY
+                     ? static_cast<const ast::Unary*>(node)->operand
+                     : static_cast<const ast::Binary*>(node)->first;
+        }
+        emitLiteral(node);
+        while (true) {
+          if (stack.empty()) return;
+          auto& [top, secondDone] = stack.back();
+          if (top->kind == ast::Node::Kind::BINARY && not secondDone) {
+            secondDone = true;
+            node = static_cast<const ast::Binary*>(top)->second;
+            break;
+          }
+          if (top->kind == ast::Node::Kind::UNARY) {
+            emitUnary(static_cast<const ast::Unary*>(top));
+          } else {
+            emitBinary(static_cast<const ast::Binary*>(top));
+          }
+          stack.pop_back();
+        }
+      }
+    }
+
+    void emitLiteral(const ast::Node* node) {
+      switch (node->kind) {
+        case ast::Node::Kind::NUMBER:
+          emitConstant(ast::Value(static_cast<const ast::Number*>(node)->val));
+          break;
+        case ast::Node::Kind::STRING:
+          emitConstant(ast::Value(static_cast<const ast::String*>(node)->val));
+          break;
+        case ast::Node::Kind::BOOL: {
+          const bool val = static_cast<const ast::Bool*>(node)->val;
+          emit(val ? OpCode::TRUE : OpCode::FALSE, 0, 1);
+          break;
+        }
+        default:
+          emit(OpCode::NIL, 0, 1);
+          break;
+      }
+    }
+    void emitUnary(const ast::Unary* obj) {
+      const int location = obj->opToken.location();
+      switch (obj->op) {
+        case ast::Unary::MINUS:
+          emit(OpCode::NEGATE, location, 0);
+          break;
+        case ast::Unary::BANG:
+          emit(OpCode::NOT, location, 0);
+          break;
+      }
+    }
+    void emitBinary(const ast::Binary* obj) {
+      const int location = obj->opToken.location();
+      OpCode op = OpCode::ADD;
+      switch (obj->op) {
+        case ast::Binary::MINUS:         op = OpCode::SUBTRACT; break;
+        case ast::Binary::PLUS:          op = OpCode::ADD; break;
+        case ast::Binary::SLASH:         op = OpCode::DIVIDE; break;
+        case ast::Binary::STAR:          op = OpCode::MULTIPLY; break;
+        case ast::Binary::BANG_EQUAL:    op = OpCode::NOT_EQUAL; break;
+        case ast::Binary::EQUAL_EQUAL:   op = OpCode::EQUAL; break;
+        case ast::Binary::GREATER:       op = OpCode::GREATER; break;
+        case ast::Binary::GREATER_EQUAL: op = OpCode::GREATER_EQUAL; break;
+        case ast::Binary::LESS:          op = OpCode::LESS; break;
+        case ast::Binary::LESS_EQUAL:    op = OpCode::LESS_EQUAL; break;
+      }
+      emit(op, location, -1);
+    }
+
+    // Emits @op and tracks the effect it has on the operand stack depth.
+    void emit(OpCode op, int location, int stackEffect) {
+      chunk_->write(op, location);
+      depth_ += stackEffect;
+      maxDepth_ = std::max(maxDepth_, depth_);
+    }
+    void emitConstant(const ast::Value& v) {
+      if (++numConstants_ > kMaxConstants) return;
+      chunk_->writeConstant(v, 0);
+      maxDepth_ = std::max(maxDepth_, ++depth_);
+    }
+
+    Chunk* chunk_;
+    size_t numConstants_ = 0;
+    int depth_ = 0;
+    int maxDepth_ = 0;
+  };
+};
+
+}  // namespace vm
+}  // namespace lox
@@ -0,0 +1,9 @@
+mkdir -p build-out
+cd build-out
+MYCFLAGS="-g -O3 $CFLAGS"
+cmake .. -DBENCHMARK_ENABLE_TESTING=OFF \
+         -DBENCHMARK_ENABLE_GTEST_TESTS=OFF \
+         -DCMAKE_BUILD_TYPE=RelWithDebInfo \
+         -DCMAKE_CXX_FLAGS_RELWITHDEBINFO="$MYCFLAGS"
+make -j $PARALLELISM VERBOSE=1
+sudo make install
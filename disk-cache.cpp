@@ -0,0 +1,111 @@
+#include "disk-cache.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hash.hpp"
+#include "source-file.hpp"
+
+namespace lox {
+
+namespace {
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t sourceHash[2];
+  uint64_t sourceSize;
+  uint64_t payloadSize;
+  uint64_t payloadHash;
+};
+
+static_assert(sizeof(Header) % 8 == 0, "Header must keep payload aligned");
+
+constexpr char kMagic[4] = {'L', 'O', 'X', 'C'};
+
+Header makeHeader(const DiskCache::Key& key) {
+  Header h = {};
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = DiskCache::kVersion;
+  h.sourceHash[0] = key.hash[0];
+  h.sourceHash[1] = key.hash[1];
+  h.sourceSize = key.size;
+  return h;
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = ::write(fd, data, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+}  // namespace
+
+DiskCache::Key DiskCache::key(std::string_view source) {
+  Key key;
+  key.hash[0] = hashBytes(source, 0);
+  key.hash[1] = hashBytes(source, key.hash[0]);
+  key.size = source.size();
+  return key;
+}
+
+std::string DiskCache::path(const Key& key) const {
+  return fmt::format("{}/{:016x}{:016x}.loxc", dir_, key.hash[0],
+                     key.hash[1]);
+}
+
+bool DiskCache::load(const Key& key, ast::FlatTree* tree) const {
+  SourceFile file;
+  if (not file.open(path(key).c_str())) return false;
+  const std::string_view data = file.view();
+  const Header expected = makeHeader(key);
+  Header h;
+  if (data.size() < sizeof(h)) return false;
+  std::memcpy(&h, data.data(), sizeof(h));
+  const std::string_view payload = data.substr(sizeof(h));
+  if (std::memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0 ||
+      h.version != expected.version ||
+      h.sourceHash[0] != expected.sourceHash[0] ||
+      h.sourceHash[1] != expected.sourceHash[1] ||
+      h.sourceSize != expected.sourceSize ||
+      h.payloadSize != payload.size() ||
+      h.payloadHash != hashBytes(payload)) {
+    return false;
+  }
+  return tree->decode(payload) && not tree->empty();
+}
+
+bool DiskCache::store(const Key& key, const ast::FlatTree& tree) const {
+  if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) return false;
+  std::string data(sizeof(Header), '\0');
+  tree.encode(&data);
+  Header h = makeHeader(key);
+  const std::string_view payload(data.data() + sizeof(h),
+                                 data.size() - sizeof(h));
+  h.payloadSize = payload.size();
+  h.payloadHash = hashBytes(payload);
+  std::memcpy(data.data(), &h, sizeof(h));
+
+  const std::string target = path(key);
+  const std::string temp = fmt::format("{}.{}.tmp", target, ::getpid());
+  const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  const bool written = writeAll(fd, data.data(), data.size());
+  if (::close(fd) != 0 || not written ||
+      std::rename(temp.c_str(), target.c_str()) != 0) {
+    ::unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace lox
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "flat-ast.hpp"
+
+namespace lox {
+
+// Directory of parsed programs, so that running an unchanged program again
+// skips scanning and parsing. Each program is stored in its own .loxc file
+// named after a 128-bit hash of its source:
+//
+//   header   magic "LOXC", format version, source hash and size, and the
+//            size and hash of the payload.
+//   payload  the FlatTree::encode() encoding of the parsed program.
+//
+// The header is 8-byte aligned, so a mapped file keeps the alignment of the
+// encoded arrays. Files are written to a temporary name and renamed into
+// place, so readers never observe a partially written entry. Any entry
+// that does not match in every field, including one left by another
+// version of the format, is treated as a miss.
+class DiskCache {
+ public:
+  static constexpr uint32_t kVersion = 1;
+
+  // Identifies the entry of a source: its hash and size. Computing it reads
+  // the whole source, so callers compute it once and pass it to every call.
+  struct Key {
+    uint64_t hash[2];
+    uint64_t size;
+  };
+
+  explicit DiskCache(std::string dir) : dir_(std::move(dir)) {}
+
+  static Key key(std::string_view source);
+
+  // Loads the program cached under @key into @tree. Returns false if there
+  // is no usable entry.
+  bool load(const Key& key, ast::FlatTree* tree) const;
+  // Caches @tree as the parse of the source of @key, creating the directory
+  // if needed. Best effort: returns false if the entry could not be written.
+  bool store(const Key& key, const ast::FlatTree& tree) const;
+  // Path of the entry for @key.
+  std::string path(const Key& key) const;
+
+ private:
+  std::string dir_;
+};
+
+}  // namespace lox
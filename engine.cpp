@@ -0,0 +1,324 @@
+#include "engine.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "ast-eval.hpp"
+#include "ast-opt.hpp"
+#include "compiler.hpp"
+#include "disk-cache.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "source-file.hpp"
+#include "stream-input.hpp"
+#include "thread-pool.hpp"
+#include "trace.hpp"
+#include "vm.hpp"
+
+namespace lox {
+
+namespace {
+
+void printValue(std::ostream& out, const ast::Value& value) {
+  switch (value.type()) {
+    case ast::ValueType::NIL:
+      out << "nil\n";
+      break;
+    case ast::ValueType::BOOL:
+      out << (value.b() ? "true\n" : "false\n");
+      break;
+    case ast::ValueType::NUMBER:
+      out << value.d() << std::endl;
+      break;
+    case ast::ValueType::STRING:
+      out << value.s() << std::endl;
+      break;
+    default:
+      out << "Unexpected type: " << static_cast<int>(value.type()) << "\n";
+      break;
+  }
+}
+
+void printErrors(std::ostream& out, const ErrorReporter& err) {
+  for (int i = 0; i < err.numErrors(); ++i) {
+    out << "Error: location=" << err.error(i).location
+        << ", msg=" << err.error(i).msg << std::endl;
+  }
+}
+
+// Prints the value of a program that ran to completion, or its runtime
+// error, as part of the PRINT phase of @stats.
+void printResult(std::ostream& out, Stats* stats, bool ok,
+                 const ast::Value& value, const std::string& message,
+                 int location) {
+  PhaseTimer timer(stats, Stats::PRINT);
+  if (ok) {
+    printValue(out, value);
+  } else {
+    out << "Runtime error: msg=" << message << ", location: " << location
+        << "\n";
+  }
+}
+
+// Splits @src into lines, without their terminating newlines. A newline at
+// the very end does not start another line.
+std::vector<std::string_view> splitLines(std::string_view src) {
+  std::vector<std::string_view> lines;
+  while (not src.empty()) {
+    const size_t eol = std::min(src.find('\n'), src.size());
+    lines.push_back(src.substr(0, eol));
+    src.remove_prefix(std::min(eol + 1, src.size()));
+  }
+  return lines;
+}
+
+}  // namespace
+
+LoxEngine::LoxEngine(Options options)
+    : options_(std::move(options)), cache_(options_.cacheBytes) {}
+
+bool LoxEngine::runInteractive() {
+  while (std::cin.good()) {
+    std::string program;
+    std::cout << "> ";
+    // TODO: Support multi-line inputs perhaps escaped via backslash.
+    std::getline(std::cin, program);
+    // TODO: Implement exit as a proper part of the language.
+    if (program == "exit") return true;
+    ErrorReporter err(program);
+    runCached(std::cout, &err, statsOrNull(), program);
+  }
+  return false;
+}
+
+bool LoxEngine::runFile(const char* filename) {
+  if (std::string_view(filename) == "-") return runStream(STDIN_FILENO);
+  SourceFile program;
+  {
+    PhaseTimer timer(statsOrNull(), Stats::READ);
+    if (not program.open(filename)) return false;
+  }
+  if (not options_.profileOut.empty()) return runProfiled(program.view());
+  if (not options_.cacheDir.empty()) return runDiskCached(program.view());
+  return run(program.view());
+}
+
+bool LoxEngine::runProfiled(std::string_view src) {
+  ErrorReporter err(src);
+  if (not profile::start(options_.profileHz)) {
+    std::cerr << "lox: cannot start the profiler\n";
+    return false;
+  }
+  const bool ok = run(std::cout, &err, statsOrNull(), src.data(),
+                      src.data() + src.size());
+  profile::stop();
+  if (profile::dropped() > 0) {
+    std::cerr << "lox: profile buffer full, dropped " << profile::dropped()
+              << " samples\n";
+  }
+  if (not profile::write(options_.profileOut, err)) {
+    std::cerr << "lox: cannot write profile to " << options_.profileOut
+              << "\n";
+    return false;
+  }
+  return ok;
+}
+
+bool LoxEngine::runStream(int fd) {
+  StreamInput in(fd);
+  ErrorReporter err({});
+  const bool ok =
+      run(std::cout, &err, statsOrNull(), in.begin(), in.end());
+  return ok && not in.failed();
+}
+
+bool LoxEngine::runBatch(const char* filename, size_t threads) {
+  SourceFile program;
+  std::vector<std::string_view> lines;
+  {
+    PhaseTimer timer(statsOrNull(), Stats::READ);
+    if (not program.open(filename)) return false;
+    lines = splitLines(program.view());
+  }
+  ThreadPool pool(threads);
+  std::vector<ErrorReporter> reporters(pool.size(), ErrorReporter({}));
+  std::vector<Stats> stats(collectStats_ ? pool.size() : 0);
+  const size_t numBlocks = (lines.size() + kBatchBlock - 1) / kBatchBlock;
+  // Blocks are run a window at a time to bound the buffered output.
+  std::vector<std::string> output(
+      std::min(numBlocks, kBatchWindow * pool.size()));
+  for (size_t first = 0; first < numBlocks; first += output.size()) {
+    const size_t n = std::min(output.size(), numBlocks - first);
+    pool.parallelFor(n, [&](size_t task, size_t worker) {
+      trace::Span span("block");
+      std::ostringstream out;
+      const size_t begin = (first + task) * kBatchBlock;
+      const size_t end = std::min(begin + kBatchBlock, lines.size());
+      for (size_t i = begin; i < end; ++i) {
+        ErrorReporter* err = &reporters[worker];
+        err->reset(lines[i]);
+        runCached(out, err, stats.empty() ? nullptr : &stats[worker],
+                  lines[i]);
+      }
+      output[task] = out.str();
+    });
+    for (size_t i = 0; i < n; ++i) std::cout << output[i];
+  }
+  std::cout.flush();
+  for (const Stats& s : stats) stats_.merge(s);
+  return true;
+}
+
+bool LoxEngine::run(std::string_view src) {
+  ErrorReporter err(src);
+  return run(std::cout, &err, statsOrNull(), src.data(),
+             src.data() + src.size());
+}
+
+template <typename Iterator>
+bool LoxEngine::run(std::ostream& out, ErrorReporter* err, Stats* stats,
+                    Iterator begin, Iterator end) {
+  const ast::Tree tree = parse(out, err, stats, begin, end);
+  return tree ? execute(out, err, stats, tree) : true;
+}
+
+bool LoxEngine::runCached(std::ostream& out, ErrorReporter* err, Stats* stats,
+                          std::string_view src) {
+  if (cache_.budget() == 0) {
+    return run(out, err, stats, src.data(), src.data() + src.size());
+  }
+  std::shared_ptr<const Program> program = cache_.find(src);
+  if (not program) {
+    // The tree's tokens point into the source, so parse the copy owned
+    // by the program rather than @src.
+    auto parsed = std::make_shared<Program>();
+    parsed->source.assign(src);
+    const char* begin = parsed->source.data();
+    parsed->tree =
+        parse(out, err, stats, begin, begin + parsed->source.size());
+    if (not parsed->tree) return true;
+    cache_.insert(parsed);
+    program = std::move(parsed);
+  }
+  return execute(out, err, stats, program->tree);
+}
+
+bool LoxEngine::runDiskCached(std::string_view src) {
+  Stats* stats = statsOrNull();
+  DiskCache cache(options_.cacheDir);
+  ErrorReporter err(src);
+  ast::FlatTree flat;
+  DiskCache::Key key;
+  bool loaded;
+  {
+    PhaseTimer timer(stats, Stats::PARSE);
+    key = DiskCache::key(src);
+    loaded = cache.load(key, &flat);
+  }
+  if (not loaded) {
+    PhaseTimer timer(stats, Stats::PARSE);
+    Parser parser(&err, src.data(), src.data() + src.size());
+    parser.tokenStream().setStats(stats);
+    flat = parser.parseFlat();
+    if (err.hasErrors()) {
+      printErrors(std::cout, err);
+      return true;
+    }
+    cache.store(key, flat);
+  }
+  if (stats) stats->countNodes(flat);
+  // The flat form is evaluated directly; everything else takes a Tree.
+  if (options_.engine == "ast" && not options_.opt && not options_.jit) {
+    return execute(std::cout, stats, flat);
+  }
+  ast::Tree tree;
+  {
+    PhaseTimer timer(stats, Stats::PARSE);
+    tree = flat.toTree();
+    if (options_.opt) ast::Optimizer::foldConstants(&tree);
+  }
+  return execute(std::cout, &err, stats, tree);
+}
+
+template <typename Iterator>
+ast::Tree LoxEngine::parse(std::ostream& out, ErrorReporter* err, Stats* stats,
+                           Iterator begin, Iterator end) {
+  ast::Tree parsed;
+  {
+    PhaseTimer timer(stats, Stats::PARSE);
+    Parser parser(err, begin, end);
+    parser.tokenStream().setStats(stats);
+    parsed = parser.parse();
+    if (not err->hasErrors() && options_.opt) {
+      ast::Optimizer::foldConstants(&parsed);
+    }
+  }
+  if (err->hasErrors()) {
+    printErrors(out, *err);
+    return {};
+  }
+  if (stats) stats->countNodes(parsed.get());
+  return parsed;
+}
+
+bool LoxEngine::execute(std::ostream& out, ErrorReporter* err, Stats* stats,
+                        const ast::Tree& parsed) {
+  if (stats) ++stats->programs;
+  if (options_.engine == "vm") {
+    vm::Chunk chunk;
+    ast::Value value;
+    vm::VM::Status status;
+    {
+      PhaseTimer timer(stats, Stats::EVAL);
+      if (not vm::Compiler::compile(parsed.get(), &chunk, err)) {
+        printErrors(out, *err);
+        return true;
+      }
+      status = vm::VM::run(chunk, &value);
+    }
+    if (stats && not status.ok) ++stats->typeErrors;
+    printResult(out, stats, status.ok, value, status.message,
+                status.location);
+    return true;
+  }
+  ast::Value value;
+  ast::Evaluator::Status status;
+  {
+    PhaseTimer timer(stats, Stats::EVAL);
+    if (options_.jit) {
+      const jit::Program program(parsed.get());
+      status = program.eval(&value);
+    } else {
+      status = ast::Evaluator::eval(parsed.get(), &value,
+                                    stats ? &stats->evalVisits : nullptr);
+    }
+  }
+  if (stats && not status.ok) ++stats->typeErrors;
+  printResult(out, stats, status.ok, value, status.message,
+              status.token.location());
+  return true;
+}
+
+bool LoxEngine::execute(std::ostream& out, Stats* stats,
+                        const ast::FlatTree& parsed) {
+  if (stats) ++stats->programs;
+  ast::Value value;
+  ast::Evaluator::Status status;
+  {
+    PhaseTimer timer(stats, Stats::EVAL);
+    status = ast::Evaluator::eval(parsed, &value,
+                                  stats ? &stats->evalVisits : nullptr);
+  }
+  if (stats && not status.ok) ++stats->typeErrors;
+  printResult(out, stats, status.ok, value, status.message,
+              status.token.location());
+  return true;
+}
+
+}  // namespace lox
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "ast.hpp"
+#include "error-reporter.hpp"
+#include "flat-ast.hpp"
+#include "program-cache.hpp"
+#include "stats.hpp"
+
+namespace lox {
+
+// Runs Lox programs the way the lox binary does: each program is parsed,
+// then evaluated by the engine chosen in Options, and its value or first
+// error printed to standard output.
+class LoxEngine {
+ public:
+  struct Options {
+    // Execution engine: "ast" walks the syntax tree, "vm" compiles to
+    // bytecode and runs it on the stack VM.
+    std::string engine = "ast";
+    // Fold constant subexpressions before running.
+    bool opt = false;
+    // Compile arithmetic to native code; ast engine only.
+    bool jit = false;
+    // Directory caching parsed program files; empty disables it.
+    std::string cacheDir;
+    // Memory budget for reusing parsed programs that repeat, or 0.
+    size_t cacheBytes = 0;
+    // File to write a folded-stack profile of a program file's source to,
+    // sampled @profileHz times per CPU second; empty disables it.
+    std::string profileOut;
+    int profileHz = 1000;
+  };
+
+  explicit LoxEngine(Options options);
+
+  bool runInteractive();
+  // Runs the program in @filename, or streamed from standard input if it
+  // is "-".
+  bool runFile(const char* filename);
+  // Runs @src under the sampling profiler and writes the profile to
+  // Options::profileOut. The program is always parsed, so that it is
+  // evaluated by the tree-walker, which maintains the stacks being sampled.
+  bool runProfiled(std::string_view src);
+  // Scans the program straight from @fd in bounded chunks, without ever
+  // holding all of its source in memory. Memory still grows with the
+  // parsed tree and with the string literals it interns.
+  bool runStream(int fd);
+  // Runs every line of @filename as an independent program on a pool of
+  // @threads workers (0 for one per hardware thread). Lines are handed out
+  // in blocks, each worker reusing its own ErrorReporter, and the output
+  // of each block is buffered so that results are printed in input order.
+  bool runBatch(const char* filename, size_t threads);
+  const ProgramCache& cache() const { return cache_; }
+
+  // Whether to collect Stats for the programs run from now on.
+  void setCollectStats(bool collect) { collectStats_ = collect; }
+  // Stats of everything run while collecting them.
+  const Stats& stats() const { return stats_; }
+  void resetStats() { stats_ = Stats(); }
+
+ private:
+  // Lines per task handed to the pool in batch mode.
+  static constexpr size_t kBatchBlock = 256;
+  // Tasks per worker in flight before their output is written.
+  static constexpr size_t kBatchWindow = 64;
+
+  Stats* statsOrNull() {
+    return kStatsEnabled && collectStats_ ? &stats_ : nullptr;
+  }
+
+  bool run(std::string_view src);
+  template <typename Iterator>
+  bool run(std::ostream& out, ErrorReporter* err, Stats* stats,
+           Iterator begin, Iterator end);
+  // Same as run(), but looks @src up in the cache first and caches the
+  // program after parsing it, so repeated programs are parsed only once.
+  bool runCached(std::ostream& out, ErrorReporter* err, Stats* stats,
+                 std::string_view src);
+  // Same as run(), but loads the parsed program from the Options::cacheDir
+  // entry for @src if there is a valid one, and writes one otherwise.
+  bool runDiskCached(std::string_view src);
+  // Parses and, with Options::opt, optimizes a program. Errors are printed
+  // to @out and leave the returned tree empty.
+  template <typename Iterator>
+  ast::Tree parse(std::ostream& out, ErrorReporter* err, Stats* stats,
+                  Iterator begin, Iterator end);
+  bool execute(std::ostream& out, ErrorReporter* err, Stats* stats,
+               const ast::Tree& parsed);
+  bool execute(std::ostream& out, Stats* stats,
+               const ast::FlatTree& parsed);
+
+  const Options options_;
+  ProgramCache cache_;
+  bool collectStats_ = false;
+  Stats stats_;
+};
+
+}  // namespace lox
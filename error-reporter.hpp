@@ -2,27 +2,38 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace lox {
 
 // Simple utility class to collect errors as recorded by the Lox interpreter.
+// The source is viewed, not copied, and must outlive the reporter.
 class ErrorReporter {
  public:
   struct Error {
     int location;
     std::string msg;
   };
-  ErrorReporter(const std::string& src) : src_(src) {}
+  ErrorReporter(std::string_view src) : src_(src) {}
   void report(int location, const std::string& msg) {
     errors_.push_back({location, msg});
   }
+  // Drops all recorded errors and starts reporting against @src, so that one
+  // reporter can be reused for many programs.
+  void reset(std::string_view src) {
+    src_ = src;
+    errors_.clear();
+  }
   bool hasErrors() const { return errors_.size() > 0; }
   int numErrors() const { return errors_.size(); }
   const Error& error(int i) const { return errors_[i]; }
+  // The source errors are reported against, e.g. to map locations back to
+  // lines and columns.
+  std::string_view source() const { return src_; }
 
  private:
-  std::string src_;
+  std::string_view src_;
   std::vector<Error> errors_;
 };
 
@@ -0,0 +1,172 @@
+#include "flat-ast.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+namespace lox {
+namespace ast {
+
+namespace {
+
+// Counts that prefix the encoding.
+struct EncodedHeader {
+  uint32_t nodes;
+  uint32_t numbers;
+  uint32_t strings;
+  uint32_t stringBytes;
+};
+
+template <typename T> void put(std::string* out, const T* data, size_t n) {
+  static_assert(std::is_trivially_copyable<T>::value, "");
+  out->resize(out->size() + (alignof(T) - out->size() % alignof(T)) %
+                                alignof(T));
+  out->append(reinterpret_cast<const char*>(data), n * sizeof(T));
+}
+
+// Reads consecutive arrays out of an encoding, mirroring put().
+class Reader {
+ public:
+  explicit Reader(std::string_view in) : in_(in) {}
+
+  template <typename T> bool get(std::vector<T>* out, size_t n) {
+    pos_ += (alignof(T) - pos_ % alignof(T)) % alignof(T);
+    if (pos_ > in_.size() || (in_.size() - pos_) / sizeof(T) < n) {
+      return false;
+    }
+    out->resize(n);
+    if (n > 0) std::memcpy(out->data(), in_.data() + pos_, n * sizeof(T));
+    pos_ += n * sizeof(T);
+    return true;
+  }
+  bool done() const { return pos_ == in_.size(); }
+
+ private:
+  std::string_view in_;
+  size_t pos_ = 0;
+};
+
+}  // namespace
+
+Tree FlatTree::toTree() const {
+  if (empty()) return {};
+  TreeBuilder b;
+  std::vector<TreeBuilder::Ref> refs(size());
+  for (Index i = 0; i < size(); ++i) {
+    switch (kind(i)) {
+      case Kind::NUMBER:
+        refs[i] = b.number(number(i));
+        break;
+      case Kind::STRING:
+        refs[i] = b.string(string(i));
+        break;
+      case Kind::BOOL:
+        refs[i] = b.boolean(boolean(i));
+        break;
+      case Kind::NIL:
+        refs[i] = b.nil();
+        break;
+      case Kind::UNARY:
+        refs[i] = b.unary(unaryOp(i), opToken(i), refs[operand(i)]);
+        break;
+      case Kind::BINARY:
+        refs[i] = b.binary(binaryOp(i), opToken(i), refs[first(i)],
+                           refs[second(i)]);
+        break;
+    }
+  }
+  return b.finish(refs[root()]);
+}
+
+void FlatTree::encode(std::string* out) const {
+  EncodedHeader header = {size(), static_cast<uint32_t>(numbers_.size()),
+                          static_cast<uint32_t>(strings_.size()), 0};
+  std::vector<uint32_t> lengths;
+  lengths.reserve(strings_.size());
+  for (Symbol s : strings_) {
+    lengths.push_back(s.str().size());
+    header.stringBytes += s.str().size();
+  }
+  // Alignment is relative to the start of the encoding.
+  std::string encoded;
+  put(&encoded, &header, 1);
+  put(&encoded, kinds_.data(), kinds_.size());
+  put(&encoded, ops_.data(), ops_.size());
+  put(&encoded, first_.data(), first_.size());
+  put(&encoded, second_.data(), second_.size());
+  put(&encoded, locations_.data(), locations_.size());
+  put(&encoded, numbers_.data(), numbers_.size());
+  put(&encoded, lengths.data(), lengths.size());
+  for (Symbol s : strings_) encoded.append(s.str());
+  out->append(encoded);
+}
+
+bool FlatTree::decode(std::string_view in) {
+  clear();
+  Reader reader(in);
+  std::vector<EncodedHeader> header;
+  std::vector<uint32_t> lengths;
+  std::vector<char> chars;
+  if (not reader.get(&header, 1)) return false;
+  const EncodedHeader& h = header[0];
+  FlatTree t;
+  if (not reader.get(&t.kinds_, h.nodes) ||
+      not reader.get(&t.ops_, h.nodes) ||
+      not reader.get(&t.first_, h.nodes) ||
+      not reader.get(&t.second_, h.nodes) ||
+      not reader.get(&t.locations_, h.nodes) ||
+      not reader.get(&t.numbers_, h.numbers) ||
+      not reader.get(&lengths, h.strings) ||
+      not reader.get(&chars, h.stringBytes) || not reader.done()) {
+    return false;
+  }
+  size_t pos = 0;
+  for (uint32_t length : lengths) {
+    if (length > chars.size() - pos) return false;
+    t.strings_.push_back(intern({chars.data() + pos, length}));
+    pos += length;
+  }
+  if (pos != chars.size()) return false;
+
+  // Replay the evaluation stack to check that every operator refers to
+  // exactly the operands a post-order walk would leave on top of it.
+  std::vector<Index> stack;
+  for (Index i = 0; i < t.size(); ++i) {
+    switch (t.kinds_[i]) {
+      case Kind::NUMBER:
+        if (t.first_[i] >= t.numbers_.size()) return false;
+        break;
+      case Kind::STRING:
+        if (t.first_[i] >= t.strings_.size()) return false;
+        break;
+      case Kind::BOOL:
+        if (t.ops_[i] > 1) return false;
+        break;
+      case Kind::NIL:
+        break;
+      case Kind::UNARY:
+        if (t.ops_[i] > Unary::BANG || stack.empty() ||
+            stack.back() != t.first_[i]) {
+          return false;
+        }
+        stack.pop_back();
+        break;
+      case Kind::BINARY:
+        if (t.ops_[i] > Binary::LESS_EQUAL || stack.size() < 2 ||
+            stack[stack.size() - 2] != t.first_[i] ||
+            stack.back() != t.second_[i]) {
+          return false;
+        }
+        stack.resize(stack.size() - 2);
+        break;
+      default:
+        return false;
+    }
+    stack.push_back(i);
+  }
+  if (t.size() > 0 && stack.size() != 1) return false;
+  *this = std::move(t);
+  return true;
+}
+
+}  // namespace ast
+}  // namespace lox
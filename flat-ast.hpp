@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "intern.hpp"
+#include "token.hpp"
+#include "token-type.hpp"
+
+namespace lox {
+namespace ast {
+
+// Index based, struct-of-arrays encoding of an expression tree. Node i is
+// described by kinds_[i], ops_[i], first_[i], second_[i] and locations_[i].
+// Nodes are stored in post-order: children always precede their parent and
+// the root is the last node. Consumers can therefore evaluate a tree with a
+// single linear pass, and nothing in it needs pointer chasing.
+//
+// For literals, first_ holds an index into the matching payload table
+// (numbers_ or strings_) and ops_ holds the value of booleans.
+class FlatTree {
+ public:
+  using Index = uint32_t;
+  enum class Kind : uint8_t { NUMBER, STRING, BOOL, NIL, UNARY, BINARY };
+
+  bool empty() const { return kinds_.empty(); }
+  explicit operator bool() const { return not empty(); }
+  Index size() const { return kinds_.size(); }
+  Index root() const { return size() - 1; }
+
+  Kind kind(Index i) const { return kinds_[i]; }
+  Unary::Operator unaryOp(Index i) const {
+    return static_cast<Unary::Operator>(ops_[i]);
+  }
+  Binary::Operator binaryOp(Index i) const {
+    return static_cast<Binary::Operator>(ops_[i]);
+  }
+  Index operand(Index i) const { return first_[i]; }
+  Index first(Index i) const { return first_[i]; }
+  Index second(Index i) const { return second_[i]; }
+  double number(Index i) const { return numbers_[first_[i]]; }
+  Symbol string(Index i) const { return strings_[first_[i]]; }
+  bool boolean(Index i) const { return ops_[i] != 0; }
+  // Source location of the operator of a unary or binary node.
+  int location(Index i) const { return locations_[i]; }
+  // Reconstructs the operator token of a unary or binary node.
+  Token opToken(Index i) const;
+
+  Index addNumber(double val) {
+    numbers_.push_back(val);
+    return add(Kind::NUMBER, 0, numbers_.size() - 1, 0, 0);
+  }
+  Index addString(Symbol val) {
+    strings_.push_back(val);
+    return add(Kind::STRING, 0, strings_.size() - 1, 0, 0);
+  }
+  Index addBool(bool val) { return add(Kind::BOOL, val, 0, 0, 0); }
+  Index addNil() { return add(Kind::NIL, 0, 0, 0, 0); }
+  Index addUnary(Unary::Operator op, int location, Index operand) {
+    return add(Kind::UNARY, op, operand, 0, location);
+  }
+  Index addBinary(Binary::Operator op, int location, Index first,
+                  Index second) {
+    return add(Kind::BINARY, op, first, second, location);
+  }
+  void clear() { *this = FlatTree(); }
+
+  // Expands the tree into its pointer-linked form, e.g. for consumers that
+  // only accept a Tree. Runs in one linear pass, without recursion.
+  Tree toTree() const;
+
+  // Appends a binary encoding of the tree to @out. The arrays are laid out
+  // back to back, each aligned to its element size relative to the start
+  // of the encoding, so that the encoding can be used straight from a
+  // suitably aligned mapped file.
+  void encode(std::string* out) const;
+  // Replaces the tree with the one encoded in @in. Every tag and index is
+  // validated, so on corrupt input this fails, leaving the tree empty,
+  // rather than producing a tree that would crash its consumers.
+  bool decode(std::string_view in);
+
+ private:
+  Index add(Kind kind, uint8_t op, Index first, Index second, int location) {
+    kinds_.push_back(kind);
+    ops_.push_back(op);
+    first_.push_back(first);
+    second_.push_back(second);
+    locations_.push_back(location);
+    return kinds_.size() - 1;
+  }
+
+  std::vector<Kind> kinds_;
+  std::vector<uint8_t> ops_;
+  std::vector<Index> first_;
+  std::vector<Index> second_;
+  std::vector<uint32_t> locations_;
+  std::vector<double> numbers_;
+  std::vector<Symbol> strings_;
+};
+
+inline Token FlatTree::opToken(Index i) const {
+  TokenType type = TokenType::END_OF_FILE;
+  if (kind(i) == Kind::UNARY) {
+    type = unaryOp(i) == Unary::MINUS ? TokenType::MINUS : TokenType::BANG;
+  } else if (kind(i) == Kind::BINARY) {
+    switch (binaryOp(i)) {
+      case Binary::MINUS:         type = TokenType::MINUS; break;
+      case Binary::PLUS:          type = TokenType::PLUS; break;
+      case Binary::SLASH:         type = TokenType::SLASH; break;
+      case Binary::STAR:          type = TokenType::STAR; break;
+      case Binary::BANG_EQUAL:    type = TokenType::BANG_EQUAL; break;
+      case Binary::EQUAL_EQUAL:   type = TokenType::EQUAL_EQUAL; break;
+      case Binary::GREATER:       type = TokenType::GREATER; break;
+      case Binary::GREATER_EQUAL: type = TokenType::GREATER_EQUAL; break;
+      case Binary::LESS:          type = TokenType::LESS; break;
+      case Binary::LESS_EQUAL:    type = TokenType::LESS_EQUAL; break;
+    }
+  }
+  return Token(type, operatorLexeme(type), location(i));
+}
+
+// Parser builder that emits a FlatTree. The parser creates children before
+// their parents, so appending nodes as they are built yields post-order.
+class FlatBuilder {
+ public:
+  using Ref = FlatTree::Index;
+  using Result = FlatTree;
+
+  Ref number(double val) { return tree_.addNumber(val); }
+  Ref string(Symbol val) { return tree_.addString(val); }
+  Ref boolean(bool val) { return tree_.addBool(val); }
+  Ref nil() { return tree_.addNil(); }
+  Ref unary(Unary::Operator op, const Token& token, Ref operand) {
+    return tree_.addUnary(op, token.location(), operand);
+  }
+  Ref binary(Binary::Operator op, const Token& token, Ref first,
+             Ref second) {
+    return tree_.addBinary(op, token.location(), first, second);
+  }
+  Result finish(Ref) { return std::move(tree_); }
+
+ private:
+  FlatTree tree_;
+};
+
+}  // namespace ast
+}  // namespace lox
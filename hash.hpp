@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace lox {
+
+namespace internal {
+
+// Folds the full 128-bit product of @a and @b into 64 bits.
+inline uint64_t mulFold(uint64_t a, uint64_t b) {
+  const __uint128_t m = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(m) ^ static_cast<uint64_t>(m >> 64);
+}
+
+}  // namespace internal
+
+// Fast non-cryptographic 64-bit hash of @bytes, consuming eight bytes per
+// multiply. Good enough to key caches, which must still compare the full
+// contents of candidates with equal hashes.
+inline uint64_t hashBytes(std::string_view bytes, uint64_t seed = 0) {
+  constexpr uint64_t kMul = 0x9e3779b97f4a7c15ull;
+  constexpr uint64_t kMix = 0xbf58476d1ce4e5b9ull;
+  const char* p = bytes.data();
+  size_t n = bytes.size();
+  uint64_t h = internal::mulFold(seed ^ kMix, n ^ kMul);
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    h = internal::mulFold(h ^ word, kMul);
+  }
+  if (n > 0) {
+    uint64_t word = 0;
+    std::memcpy(&word, p, n);
+    h = internal::mulFold(h ^ word, kMix);
+  }
+  return internal::mulFold(h, kMul);
+}
+
+}  // namespace lox
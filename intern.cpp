@@ -0,0 +1,35 @@
+#include "intern.hpp"
+
+namespace lox {
+
+InternPool& InternPool::global() {
+  static InternPool* pool = new InternPool();  // never destroyed.
+  return *pool;
+}
+
+Symbol InternPool::intern(std::string_view s) {
+  // The table buckets by the low bits of the same hash, so pick the shard
+  // with the high ones.
+  Shard& shard = shards_[Hash()(s) >> (64 - kShardBits)];
+  std::lock_guard<std::mutex> lock(shard.mu);
+  auto it = shard.table.find(s);
+  if (it != shard.table.end()) return Symbol(it->second);
+  auto obj = std::make_unique<StringObj>(std::string(s));
+  obj->immortal = true;
+  obj->interned = true;
+  StringObj* raw = obj.get();
+  shard.strings.push_back(std::move(obj));
+  shard.table.emplace(raw->str, raw);
+  return Symbol(raw);
+}
+
+size_t InternPool::size() const {
+  size_t n = 0;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mu);
+    n += shard.strings.size();
+  }
+  return n;
+}
+
+}  // namespace lox
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "hash.hpp"
+#include "object.hpp"
+
+namespace lox {
+
+// Handle to a string stored in an InternPool. Two symbols from the same pool
+// are equal iff their text is equal, so comparing them is a pointer compare.
+// A default constructed Symbol stands for the empty string.
+class Symbol {
+ public:
+  Symbol() = default;
+  const std::string& str() const { return obj_ ? obj_->str : empty(); }
+  StringObj* obj() const { return obj_; }
+  bool operator==(Symbol o) const { return obj_ == o.obj_; }
+  bool operator!=(Symbol o) const { return obj_ != o.obj_; }
+  // Refers to @obj, an immortal string owned by something other than an
+  // InternPool, e.g. an ast::Tree. Such symbols only equal themselves.
+  static Symbol unpooled(StringObj* obj) { return Symbol(obj); }
+
+ private:
+  friend class InternPool;
+  explicit Symbol(StringObj* obj) : obj_(obj) {}
+  static const std::string& empty() {
+    static const std::string kEmpty;
+    return kEmpty;
+  }
+
+  StringObj* obj_ = nullptr;
+};
+
+// Owning pool of interned strings. Each distinct string is stored exactly
+// once and lives as long as the pool. The strings are immortal StringObjs so
+// that Values can refer to them without reference counting. Thread-safe: the
+// pool is split by hash into shards with a lock each, so that threads
+// parsing different programs rarely wait for each other.
+class InternPool {
+ public:
+  InternPool() = default;
+  InternPool(const InternPool&) = delete;
+  InternPool& operator=(const InternPool&) = delete;
+
+  // Process wide pool used by the scanner, the AST and runtime values.
+  static InternPool& global();
+
+  Symbol intern(std::string_view s);
+  size_t size() const;
+
+ private:
+  static constexpr size_t kShardBits = 6;
+
+  struct Hash {
+    size_t operator()(std::string_view s) const { return hashBytes(s); }
+  };
+
+  // Padded to a cache line so that locking one shard does not slow down
+  // threads using its neighbours.
+  struct alignas(64) Shard {
+    mutable std::mutex mu;
+    // Keys point into the owned StringObj, so lookups never allocate.
+    std::unordered_map<std::string_view, StringObj*, Hash> table;
+    std::vector<std::unique_ptr<StringObj>> strings;
+  };
+
+  Shard shards_[size_t{1} << kShardBits];
+};
+
+inline Symbol intern(std::string_view s) {
+  return InternPool::global().intern(s);
+}
+
+}  // namespace lox
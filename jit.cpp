@@ -0,0 +1,476 @@
+#include "jit.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#define LOX_JIT_X86_64 1
+#endif
+
+namespace lox {
+namespace jit {
+
+namespace {
+
+// Largest number of inputs of a compiled subtree, which are addressed with
+// a 32-bit displacement.
+constexpr size_t kMaxInputs = 1 << 20;
+// Registers xmm0 to xmm15 hold the intermediate results.
+constexpr int kNumRegisters = 16;
+
+bool isArithmetic(const ast::Node* node) {
+  if (node->kind == ast::Node::Kind::UNARY) {
+    return static_cast<const ast::Unary*>(node)->op == ast::Unary::MINUS;
+  }
+  if (node->kind != ast::Node::Kind::BINARY) return false;
+  switch (static_cast<const ast::Binary*>(node)->op) {
+    case ast::Binary::MINUS:
+    case ast::Binary::PLUS:
+    case ast::Binary::SLASH:
+    case ast::Binary::STAR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+#ifdef LOX_JIT_X86_64
+
+// Emits the handful of x86-64 instructions the compiler needs. Registers
+// are xmm register numbers unless noted otherwise.
+class Assembler {
+ public:
+  enum SseOp : uint8_t { ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5c,
+                         DIVSD = 0x5e };
+
+  explicit Assembler(std::vector<uint8_t>* code) : code_(code) {}
+
+  // dst = dst op src.
+  void arith(SseOp op, int dst, int src) { sse(0xf2, op, dst, src); }
+  void movapd(int dst, int src) { sse(0x66, 0x28, dst, src); }
+  void xorpd(int dst, int src) { sse(0x66, 0x57, dst, src); }
+  // movsd dst, [rdi + disp]
+  void loadInput(int dst, uint32_t disp) {
+    byte(0xf2);
+    rex(false, dst, 0);
+    byte(0x0f);
+    byte(0x10);
+    byte(0x80 | (dst & 7) << 3 | 7);
+    for (int i = 0; i < 4; ++i) byte(disp >> (8 * i));
+  }
+  void loadConstant(int dst, double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    if (bits == 0) {
+      xorpd(dst, dst);
+      return;
+    }
+    // movabs rax, imm64
+    byte(0x48);
+    byte(0xb8);
+    for (int i = 0; i < 8; ++i) byte(bits >> (8 * i));
+    movqFromRax(dst);
+  }
+  // Flips the sign bit, going through rax.
+  void negate(int reg) {
+    // movq rax, xmm
+    byte(0x66);
+    rex(true, reg, 0);
+    byte(0x0f);
+    byte(0x7e);
+    byte(0xc0 | (reg & 7) << 3);
+    // btc rax, 63
+    for (uint8_t b : {0x48, 0x0f, 0xba, 0xf8, 0x3f}) byte(b);
+    movqFromRax(reg);
+  }
+  void ret() { byte(0xc3); }
+  // Pads with int3 up to a multiple of @align.
+  void align(size_t align) {
+    while (code_->size() % align != 0) byte(0xcc);
+  }
+
+ private:
+  void byte(uint8_t b) { code_->push_back(b); }
+  void rex(bool w, int reg, int rm) {
+    const uint8_t r = 0x40 | (w ? 8 : 0) | (reg >= 8 ? 4 : 0) |
+                      (rm >= 8 ? 1 : 0);
+    if (r != 0x40) byte(r);
+  }
+  void sse(uint8_t prefix, uint8_t op, int reg, int rm) {
+    byte(prefix);
+    rex(false, reg, rm);
+    byte(0x0f);
+    byte(op);
+    byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+  }
+  // movq xmm, rax
+  void movqFromRax(int reg) {
+    byte(0x66);
+    rex(true, reg, 0);
+    byte(0x0f);
+    byte(0x6e);
+    byte(0xc0 | (reg & 7) << 3);
+  }
+
+  std::vector<uint8_t>* code_;
+};
+
+// Compiles one arithmetic subtree into a function taking its inputs and
+// returning its value in xmm0. Registers are allocated Sethi-Ullman style:
+// of the two operands of a binary operator, the one needing more registers
+// is computed first, which keeps the register count logarithmic in the
+// size of the subtree.
+class RegionCompiler {
+ public:
+  explicit RegionCompiler(std::vector<uint8_t>* code) : as_(code) {}
+
+  // Returns false, with @inputs in an unspecified state, if the subtree
+  // needs more registers or inputs than available.
+  bool compile(const ast::Node* root,
+               std::vector<const ast::Node*>* inputs) {
+    inputs_ = inputs;
+    if (need(root) > kNumRegisters || inputs->size() > kMaxInputs) {
+      return false;
+    }
+    gen(root, 0);
+    as_.ret();
+    as_.align(16);
+    return true;
+  }
+
+ private:
+  // Registers needed to evaluate @root, and to each node under it. Also
+  // numbers the inputs in source order, since the first operand is always
+  // visited first here. Walks with an explicit stack, since parsed trees
+  // can be far deeper than the native stack allows recursing.
+  int need(const ast::Node* root) {
+    std::vector<std::pair<const ast::Node*, bool>> stack = {{root, false}};
+    // Needs of the operands visited, innermost last.
+    std::vector<int> needs;
+    while (not stack.empty()) {
+      const auto [node, childrenDone] = stack.back();
+      stack.pop_back();
+      int n = 1;
+      if (not isArithmetic(node)) {
+        if (node->kind != ast::Node::Kind::NUMBER) {
+          inputIndex_[node] = inputs_->size();
+          inputs_->push_back(node);
+        }
+      } else if (not childrenDone) {
+        stack.push_back({node, true});
+        if (node->kind == ast::Node::Kind::UNARY) {
+          stack.push_back({static_cast<const ast::Unary*>(node)->operand,
+                           false});
+        } else {
+          const auto* binary = static_cast<const ast::Binary*>(node);
+          stack.push_back({binary->second, false});
+          stack.push_back({binary->first, false});
+        }
+        continue;
+      } else if (node->kind == ast::Node::Kind::UNARY) {
+        n = needs.back();
+        needs.pop_back();
+      } else {
+        const int second = needs.back();
+        needs.pop_back();
+        const int first = needs.back();
+        needs.pop_back();
+        n = first == second ? first + 1 : std::max(first, second);
+      }
+      need_[node] = n;
+      needs.push_back(n);
+    }
+    return needs.back();
+  }
+  // Leaves the value of @root in xmm@rootReg, using only registers >=
+  // @rootReg.
+  void gen(const ast::Node* root, int rootReg) {
+    struct Step {
+      const ast::Node* node;
+      int reg;
+      bool childrenDone;
+    };
+    std::vector<Step> stack = {{root, rootReg, false}};
+    while (not stack.empty()) {
+      const auto [node, reg, childrenDone] = stack.back();
+      stack.pop_back();
+      if (not isArithmetic(node)) {
+        if (node->kind == ast::Node::Kind::NUMBER) {
+          as_.loadConstant(reg, static_cast<const ast::Number*>(node)->val);
+        } else {
+          as_.loadInput(reg, inputIndex_[node] * sizeof(double));
+        }
+        continue;
+      }
+      if (node->kind == ast::Node::Kind::UNARY) {
+        if (childrenDone) {
+          as_.negate(reg);
+        } else {
+          stack.push_back({node, reg, true});
+          stack.push_back(
+              {static_cast<const ast::Unary*>(node)->operand, reg, false});
+        }
+        continue;
+      }
+      const auto* binary = static_cast<const ast::Binary*>(node);
+      const bool firstFirst = need_[binary->first] >= need_[binary->second];
+      if (not childrenDone) {
+        stack.push_back({node, reg, true});
+        if (firstFirst) {
+          stack.push_back({binary->second, reg + 1, false});
+          stack.push_back({binary->first, reg, false});
+        } else {
+          stack.push_back({binary->first, reg + 1, false});
+          stack.push_back({binary->second, reg, false});
+        }
+        continue;
+      }
+      Assembler::SseOp op = Assembler::ADDSD;
+      switch (binary->op) {
+        case ast::Binary::MINUS: op = Assembler::SUBSD; break;
+        case ast::Binary::PLUS:  op = Assembler::ADDSD; break;
+        case ast::Binary::SLASH: op = Assembler::DIVSD; break;
+        case ast::Binary::STAR:  op = Assembler::MULSD; break;
+        default: break;
+      }
+      if (firstFirst) {
+        as_.arith(op, reg, reg + 1);
+      } else {
+        as_.arith(op, reg + 1, reg);
+        as_.movapd(reg, reg + 1);
+      }
+    }
+  }
+
+  Assembler as_;
+  std::vector<const ast::Node*>* inputs_ = nullptr;
+  std::unordered_map<const ast::Node*, int> need_;
+  std::unordered_map<const ast::Node*, uint32_t> inputIndex_;
+};
+
+#endif  // LOX_JIT_X86_64
+
+}  // namespace
+
+// Evaluates in post-order with an explicit stack, like ast::Evaluator,
+// since parsed trees can be far deeper than the native stack allows
+// recursing. A compiled subtree is entered by evaluating its inputs one at
+// a time onto inputs_, then calling its code.
+class Program::Walker {
+ public:
+  explicit Walker(const Program* program) : program_(program) {}
+
+  ast::Evaluator::Status run(ast::Value* value) {
+    pending_.push_back({program_->root_, nullptr, 0, Step::VISIT});
+    while (not pending_.empty()) {
+      const Pending p = pending_.back();
+      pending_.pop_back();
+      switch (p.step) {
+        case Step::VISIT:
+          visit(p.node);
+          break;
+        case Step::INTERPRET:
+          interpret(p.node);
+          break;
+        case Step::APPLY:
+          if (const char* error = apply(p.node)) {
+            return ast::Evaluator::Status{error, operatorToken(p.node)};
+          }
+          break;
+        case Step::INPUT:
+          input(p);
+          break;
+      }
+    }
+    *value = std::move(values_.back());
+    return {};
+  }
+
+ private:
+  enum class Step : uint8_t {
+    VISIT,      // evaluate @node.
+    INTERPRET,  // evaluate @node without its native code.
+    APPLY,      // apply the operator of @node to the values of operands.
+    INPUT,      // @next inputs of @region evaluated, the last on values_.
+  };
+  struct Pending {
+    const ast::Node* node;
+    const Region* region;
+    uint32_t next;
+    Step step;
+  };
+
+  void visit(const ast::Node* node) {
+    switch (node->kind) {
+      case ast::Node::Kind::NUMBER:
+        values_.emplace_back(static_cast<const ast::Number*>(node)->val);
+        return;
+      case ast::Node::Kind::STRING:
+        values_.emplace_back(static_cast<const ast::String*>(node)->val);
+        return;
+      case ast::Node::Kind::BOOL:
+        values_.emplace_back(static_cast<const ast::Bool*>(node)->val);
+        return;
+      case ast::Node::Kind::NIL:
+        values_.emplace_back();
+        return;
+      default:
+        break;
+    }
+    if (const Region* region = find(node)) {
+      pending_.push_back({node, region, 0, Step::INPUT});
+    } else {
+      interpret(node);
+    }
+  }
+
+  void interpret(const ast::Node* node) {
+    pending_.push_back({node, nullptr, 0, Step::APPLY});
+    if (node->kind == ast::Node::Kind::UNARY) {
+      pending_.push_back({static_cast<const ast::Unary*>(node)->operand,
+                          nullptr, 0, Step::VISIT});
+    } else {
+      const auto* binary = static_cast<const ast::Binary*>(node);
+      pending_.push_back({binary->second, nullptr, 0, Step::VISIT});
+      pending_.push_back({binary->first, nullptr, 0, Step::VISIT});
+    }
+  }
+
+  const char* apply(const ast::Node* node) {
+    if (node->kind == ast::Node::Kind::UNARY) {
+      ast::Value& operand = values_.back();
+      return ast::Evaluator::unary(
+          static_cast<const ast::Unary*>(node)->op, operand, &operand);
+    }
+    ast::Value& first = values_[values_.size() - 2];
+    const char* error =
+        ast::Evaluator::binary(static_cast<const ast::Binary*>(node)->op,
+                               first, values_.back(), &first);
+    values_.pop_back();
+    return error;
+  }
+
+  void input(const Pending& p) {
+    const std::vector<const ast::Node*>& inputs = p.region->inputs;
+    if (p.next > 0) {
+      const ast::Value last = std::move(values_.back());
+      values_.pop_back();
+      // Type guard: everything before this input was a number, so the
+      // tree-walker reaches the same point without any error.
+      if (last.type() != ast::ValueType::NUMBER) {
+        inputs_.resize(inputs_.size() - (p.next - 1));
+        interpret(p.node);
+        return;
+      }
+      inputs_.push_back(last.d());
+    }
+    if (p.next < inputs.size()) {
+      pending_.push_back({p.node, p.region, p.next + 1, Step::INPUT});
+      pending_.push_back({inputs[p.next], nullptr, 0, Step::VISIT});
+      return;
+    }
+    const size_t base = inputs_.size() - inputs.size();
+    values_.emplace_back(p.region->fn(inputs_.data() + base));
+    inputs_.resize(base);
+  }
+
+  const Region* find(const ast::Node* node) const {
+    if (program_->regions_.empty()) return nullptr;
+    auto it = program_->regions_.find(node);
+    return it == program_->regions_.end() ? nullptr : &it->second;
+  }
+  static Token operatorToken(const ast::Node* node) {
+    return node->kind == ast::Node::Kind::UNARY
+               ? static_cast<const ast::Unary*>(node)->opToken
+               : static_cast<const ast::Binary*>(node)->opToken;
+  }
+
+  const Program* program_;
+  std::vector<Pending> pending_;
+  std::vector<ast::Value> values_;
+  // Inputs of the compiled subtrees being entered, innermost last.
+  std::vector<double> inputs_;
+};
+
+Program::Program(const ast::Node* root) : root_(root) { compile(root); }
+
+Program::~Program() {
+  if (code_ != nullptr) ::munmap(code_, mappedSize_);
+}
+
+bool Program::supported() {
+#ifdef LOX_JIT_X86_64
+  return true;
+#else
+  return false;
+#endif
+}
+
+ast::Evaluator::Status Program::eval(ast::Value* value) const {
+  Walker walker(this);
+  return walker.run(value);
+}
+
+void Program::compile(const ast::Node* root) {
+#ifdef LOX_JIT_X86_64
+  std::vector<uint8_t> code;
+  std::vector<std::pair<const ast::Node*, size_t>> offsets;
+  std::vector<const ast::Node*> pending = {root};
+  while (not pending.empty()) {
+    const ast::Node* node = pending.back();
+    pending.pop_back();
+    if (isArithmetic(node)) {
+      const size_t offset = code.size();
+      Region region{nullptr, {}};
+      RegionCompiler compiler(&code);
+      if (compiler.compile(node, &region.inputs)) {
+        pending.insert(pending.end(), region.inputs.begin(),
+                       region.inputs.end());
+        offsets.emplace_back(node, offset);
+        regions_.emplace(node, std::move(region));
+        continue;
+      }
+      // Too big for one function; try its operands instead.
+      code.resize(offset);
+    }
+    if (node->kind == ast::Node::Kind::UNARY) {
+      pending.push_back(static_cast<const ast::Unary*>(node)->operand);
+    } else if (node->kind == ast::Node::Kind::BINARY) {
+      pending.push_back(static_cast<const ast::Binary*>(node)->first);
+      pending.push_back(static_cast<const ast::Binary*>(node)->second);
+    }
+  }
+  if (code.empty()) return;
+
+  // Write the code, then make it executable, never both at once.
+  const size_t page = ::sysconf(_SC_PAGESIZE);
+  const size_t size = (code.size() + page - 1) / page * page;
+  void* mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    regions_.clear();
+    return;
+  }
+  std::memcpy(mem, code.data(), code.size());
+  if (::mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    ::munmap(mem, size);
+    regions_.clear();
+    return;
+  }
+  code_ = mem;
+  codeSize_ = code.size();
+  mappedSize_ = size;
+  for (const auto& [node, offset] : offsets) {
+    regions_[node].fn =
+        reinterpret_cast<Fn>(static_cast<uint8_t*>(mem) + offset);
+  }
+#else
+  (void)root;
+#endif
+}
+
+}  // namespace jit
+}  // namespace lox
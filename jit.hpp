@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "ast-eval.hpp"
+#include "ast.hpp"
+#include "value.hpp"
+
+namespace lox {
+namespace jit {
+
+// Native code tier for the tree-walking Evaluator. Every maximal subtree
+// built only from arithmetic operators ('+', '-', '*', '/' and unary '-')
+// is compiled to x86-64 SSE2 code that keeps intermediate results in xmm
+// registers. Number literals are embedded in the code. Any other operand
+// of such a subtree, say a comparison or a string, becomes an input that
+// is evaluated by the tree-walker and passed in as a double.
+//
+// Inputs are evaluated in source order and type checked as they arrive.
+// Arithmetic on numbers cannot fail, so as long as every input is a number
+// the native code computes exactly what the tree-walker would. When an
+// input turns out not to be a number, the guard hands the whole subtree
+// back to the tree-walker, which then reports the same error, at the same
+// operator, as if the code had never been compiled.
+//
+// On other architectures nothing is compiled and eval() only interprets.
+class Program {
+ public:
+  // Compiles @root, which must outlive the program.
+  explicit Program(const ast::Node* root);
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+  ~Program();
+
+  ast::Evaluator::Status eval(ast::Value* value) const;
+
+  // Whether native code can be generated on this machine.
+  static bool supported();
+  // Number of compiled subtrees.
+  size_t numRegions() const { return regions_.size(); }
+  // Bytes of machine code generated.
+  size_t codeSize() const { return codeSize_; }
+
+ private:
+  using Fn = double (*)(const double* inputs);
+
+  struct Region {
+    Fn fn;
+    std::vector<const ast::Node*> inputs;  // in evaluation order.
+  };
+  class Walker;
+
+  void compile(const ast::Node* root);
+
+  const ast::Node* root_;
+  std::unordered_map<const ast::Node*, Region> regions_;
+  void* code_ = nullptr;
+  size_t codeSize_ = 0;
+  size_t mappedSize_ = 0;
+};
+
+}  // namespace jit
+}  // namespace lox
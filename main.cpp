@@ -1,120 +1,137 @@
-#include <fstream>
 #include <iostream>
-#include <string>
+#include <string_view>
+#include <utility>
 #include <gflags/gflags.h>
 
-#include "ast-eval.hpp"
-#include "ast-printer.hpp"
-#include "error-reporter.hpp"
-#include "parser.hpp"
-#include "token.hpp"
+#include "engine.hpp"
+#include "program-cache.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
-namespace lox {
-
-namespace {
-
-bool readFile(const char* filename, std::string* out) {
-  std::ifstream in(filename, std::ios::in | std::ios::binary);
-  if (not in) return false;
-  try {
-    in.seekg(0, std::ios::end);
-    out->resize(in.tellg());
-    in.seekg(0, std::ios::beg);
-    in.read(&(*out)[0], out->size());
-  } catch (...) {
-    return false;
-  }
-  return true;
-}
-
-}  // namespace
+DEFINE_string(engine, "ast",
+              "Execution engine: 'ast' walks the syntax tree, 'vm' compiles "
+              "to bytecode and runs it on the stack VM.");
+DEFINE_bool(opt, false,
+            "Fold constant subexpressions before running the program.");
+DEFINE_bool(jit, false,
+            "Compile arithmetic subexpressions to native code. Requires "
+            "--engine=ast.");
+DEFINE_bool(batch, false,
+            "Treat every line of PROGRAM as an independent program and run "
+            "them in parallel, printing the results in input order.");
+DEFINE_int32(threads, 0,
+             "Number of threads used by --batch; 0 uses one per hardware "
+             "thread.");
+DEFINE_string(cache_dir, "",
+              "Directory in which to cache parsed program files, so that "
+              "running an unchanged file again skips parsing; empty "
+              "disables it.");
+DEFINE_uint64(cache_bytes, 64 << 20,
+              "Memory budget for caching parsed programs that are run more "
+              "than once, in --batch and interactive mode; 0 disables it.");
+DEFINE_string(trace_out, "",
+              "File to write a Chrome trace-event timeline of the run to, "
+              "for chrome://tracing or Perfetto; empty disables tracing.");
+DEFINE_int32(trace_sample, 0,
+             "With --trace_out, also trace one in every N node visits of "
+             "the evaluator; 0 traces none.");
+DEFINE_string(profile_out, "",
+              "File to write a CPU profile of the Lox source of PROGRAM to, "
+              "as folded stacks of line:column frames; empty disables it. "
+              "Requires --engine=ast without --jit or --batch, and a "
+              "PROGRAM file rather than '-'.");
+DEFINE_int32(profile_hz, 1000,
+             "Samples per second of CPU time taken by --profile_out.");
+DEFINE_bool(stats, false,
+            "Print the time and allocations of each phase, and counts of "
+            "tokens, nodes and evaluations, to stderr when done.");
 
-class LoxEngine {
- public:
-  bool runInteractive() {
-    while (std::cin.good()) {
-      std::string program;
-      std::cout << "> ";
-      // TODO: Support multi-line inputs perhaps escaped via backslash.
-      std::getline(std::cin, program);
-      // TODO: Implement exit as a proper part of the language.
-      if (program == "exit") return true;
-      run(program);
-    }
-    return false;
-  }
-  bool runFile(const char* filename) {
-    std::string program;
-    if (not readFile(filename, &program)) return false;
-    return run(program);
-  }
-
- private:
-  bool run(const std::string& src) {
-    ErrorReporter err(src);
-    Parser parser(&err, src.begin(), src.end());
-    auto parsed = parser.parse();
-    if (err.hasErrors()) {
-      for (int i = 0; i < err.numErrors(); ++i) {
-        std::cout << "Error: location=" << err.error(i).location
-                  << ", msg=" << err.error(i).msg << std::endl;
-      }
-    } else {
-      ast::Value value;
-      ast::Evaluator::Status status =
-          ast::Evaluator::eval(parsed.get(), &value);
-      if (status.ok) {
-        switch (value.type()) {
-          case ast::ValueType::NIL:
-            std::cout << "nil\n";
-            break;
-          case ast::ValueType::BOOL:
-            std::cout << (value.b() ? "true\n" : "false\n");
-            break;
-          case ast::ValueType::NUMBER:
-            std::cout << value.d() << std::endl;
-            break;
-          case ast::ValueType::STRING:
-            std::cout << value.s() << std::endl;
-            break;
-          default:
-            std::cout << "Unexpected type: " << static_cast<int>(value.type())
-                      << "\n";
-            break;
-        }
-      } else {
-        std::cout << "Runtime error: msg=" << status.message
-                  << ", location: " << status.token.location() << "\n";
-      }
-    }
-    return true;
-  }
-};
+namespace lox {
 
 void printUsage() {
   const char* usage =
       "lox: Interpreter to run programs written in the lox programming "
       "language.\n"
-      "Usage: $ lox [PROGRAM]\n"
+      "Usage: $ lox [--engine=ast|vm] [--opt] [--jit] "
+      "[--batch [--threads=N]] [--stats] [--trace_out=FILE] "
+      "[--profile_out=FILE] [PROGRAM]\n"
       "  PROGRAM: Optional argument for the path of the program to execute.\n"
       "           If missing, the interpreter will run in interactive "
-      "mode.\n";
+      "mode.\n"
+      "           If '-', the program is streamed from standard input.\n"
+      "  --engine: Execution engine to use (default: ast).\n"
+      "  --opt: Fold constant subexpressions before running.\n"
+      "  --jit: Compile arithmetic to native code (ast engine only).\n"
+      "  --batch: Run each line of PROGRAM as a separate program, in\n"
+      "           parallel, printing results in input order.\n"
+      "  --threads: Worker threads for --batch (default: one per core).\n"
+      "  --cache_dir: Directory caching parsed program files, so that an\n"
+      "           unchanged file is not parsed again (default: none).\n"
+      "  --cache_bytes: Memory budget for reusing parsed programs that\n"
+      "           repeat in --batch or interactive mode (default: 64MiB).\n"
+      "  --stats: Print per-phase times, allocations and counters to\n"
+      "           stderr when done.\n"
+      "  --trace_out: Write a Chrome trace-event timeline to this file.\n"
+      "  --trace_sample: With --trace_out, trace every Nth node visit.\n"
+      "  --profile_out: Write a folded-stack CPU profile of PROGRAM's\n"
+      "           source to this file (ast engine, no --jit or --batch;\n"
+      "           PROGRAM must be a file, not '-').\n"
+      "  --profile_hz: Profile samples per CPU second (default: 1000).\n";
   std::cerr << usage;
 }
 
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
-  LoxEngine engine;
+  if ((FLAGS_engine != "ast" && FLAGS_engine != "vm") || FLAGS_threads < 0 ||
+      FLAGS_trace_sample < 0 || (FLAGS_batch && argc != 2) ||
+      (FLAGS_jit && FLAGS_engine != "ast") ||
+      (not FLAGS_profile_out.empty() &&
+       (FLAGS_engine != "ast" || FLAGS_jit || FLAGS_batch || argc != 2 ||
+        std::string_view(argv[1]) == "-" || FLAGS_profile_hz <= 0))) {
+    printUsage();
+    return 64;
+  }
+  if (not FLAGS_trace_out.empty()) trace::start(FLAGS_trace_sample);
+  LoxEngine::Options options;
+  options.engine = FLAGS_engine;
+  options.opt = FLAGS_opt;
+  options.jit = FLAGS_jit;
+  options.cacheDir = FLAGS_cache_dir;
+  options.cacheBytes = FLAGS_cache_bytes;
+  options.profileOut = FLAGS_profile_out;
+  options.profileHz = FLAGS_profile_hz;
+  LoxEngine engine(std::move(options));
+  engine.setCollectStats(FLAGS_stats);
+  int code;
   switch (argc) {
     case 1:
-      return engine.runInteractive() ? 0 : 1;
+      code = engine.runInteractive() ? 0 : 1;
+      break;
     case 2:
-      return engine.runFile(argv[1]) ? 0 : 65;
+      if (FLAGS_batch) {
+        code = engine.runBatch(argv[1], FLAGS_threads) ? 0 : 65;
+      } else {
+        code = engine.runFile(argv[1]) ? 0 : 65;
+      }
+      break;
     default:
       printUsage();
       return 64;
   }
-  return 1;
+  if (FLAGS_stats && not kStatsEnabled) {
+    std::cerr << "lox: built with LOX_STATS=0, no statistics collected\n";
+  } else if (FLAGS_stats) {
+    engine.stats().print(std::cerr);
+    const ProgramCache& cache = engine.cache();
+    if (cache.hits() + cache.misses() > 0) {
+      std::cerr << "cache: hits=" << cache.hits()
+                << ", misses=" << cache.misses() << "\n";
+    }
+  }
+  if (not FLAGS_trace_out.empty() && not trace::write(FLAGS_trace_out)) {
+    std::cerr << "lox: cannot write trace to " << FLAGS_trace_out << "\n";
+  }
+  return code;
 }
 
 }  // namespace lox
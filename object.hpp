@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace lox {
+
+// Base class of all heap allocated runtime objects that a Value can point
+// to. Objects are reference counted by the Values that hold them. The count
+// is deliberately not atomic: a Value, and the objects it owns, belong to a
+// single evaluation and are never shared across threads.
+struct Obj {
+  enum class Kind : uint8_t { STRING, CONCAT };
+
+  Kind kind;
+  uint32_t refs = 1;
+  // Immortal objects outlive every Value referencing them. They skip
+  // reference counting entirely, which also makes them safe to share.
+  bool immortal = false;
+
+ protected:
+  explicit Obj(Kind k) : kind(k) {}
+};
+
+struct StringObj : public Obj {
+  explicit StringObj(std::string s) : Obj(Kind::STRING), str(std::move(s)) {}
+  std::string str;
+  // Set for strings owned by an InternPool. Distinct interned strings always
+  // have distinct contents.
+  bool interned = false;
+};
+
+// String made of two others, StringObjs or ConcatObjs, whose contents are
+// only copied out the first time they are needed. This makes concatenation
+// O(1) however long its operands are. Once flattened, the children are
+// released and the contents live in @flat.
+struct ConcatObj : public Obj {
+  ConcatObj(Obj* l, Obj* r, size_t len, uint32_t d)
+    : Obj(Kind::CONCAT), left(l), right(r), length(len), depth(d) {}
+  ~ConcatObj();
+  bool flattened() const { return left == nullptr; }
+
+  // Both own a reference, and are null once flattened.
+  Obj* left;
+  Obj* right;
+  size_t length;
+  // Longest path down to a StringObj or flattened ConcatObj, 0 if flattened.
+  uint32_t depth;
+  std::string flat;
+};
+
+inline void retain(Obj* obj) {
+  if (not obj->immortal) ++obj->refs;
+}
+
+inline void release(Obj* obj) {
+  if (obj->immortal || --obj->refs > 0) return;
+  switch (obj->kind) {
+    case Obj::Kind::STRING:
+      delete static_cast<StringObj*>(obj);
+      break;
+    case Obj::Kind::CONCAT:
+      delete static_cast<ConcatObj*>(obj);
+      break;
+  }
+}
+
+// Recurses at most depth times, which Value::concat keeps small.
+inline ConcatObj::~ConcatObj() {
+  if (left) release(left);
+  if (right) release(right);
+}
+
+}  // namespace lox
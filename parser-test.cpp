@@ -1,48 +1,90 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
 #include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "ast-eval.hpp"
+#include "ast-opt.hpp"
 #include "ast-printer.hpp"
+#include "column.hpp"
+#include "compiler.hpp"
+#include "disk-cache.hpp"
+#include "engine.hpp"
+#include "jit.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
+#include "program-cache.hpp"
+#include "stats.hpp"
+#include "thread-pool.hpp"
+#include "trace.hpp"
+#include "vm.hpp"
 
 namespace lox {
 
-void MatchNil(ast::Node* node) {
+// Evaluates @node with both the tree-walking Evaluator and the bytecode VM,
+// verifies that the two engines agree, and returns the Evaluator's result.
+bool EvalBoth(const ast::Node* node, ast::Value* value) {
+  auto status = ast::Evaluator::eval(node, value);
+  std::string src;
+  ErrorReporter err(src);
+  vm::Chunk chunk;
+  EXPECT_TRUE(vm::Compiler::compile(node, &chunk, &err));
+  ast::Value vmValue;
+  auto vmStatus = vm::VM::run(chunk, &vmValue);
+  EXPECT_EQ(status.ok, vmStatus.ok);
+  if (status.ok && vmStatus.ok) {
+    EXPECT_EQ(value->type(), vmValue.type());
+    EXPECT_TRUE(value->equals(vmValue));
+  } else if (not status.ok && not vmStatus.ok) {
+    EXPECT_EQ(status.message, vmStatus.message);
+    EXPECT_EQ(status.token.location(), vmStatus.location);
+  }
+  return status.ok;
+}
+
+void MatchNil(const ast::Node* node) {
   ast::Value value;
-  auto status = ast::Evaluator::eval(node, &value);
-  EXPECT_TRUE(status.ok);
+  EXPECT_TRUE(EvalBoth(node, &value));
   EXPECT_EQ(ast::ValueType::NIL, value.type());
 }
 
-void MatchBool(ast::Node* node, bool b) {
+void MatchBool(const ast::Node* node, bool b) {
   ast::Value value;
-  auto status = ast::Evaluator::eval(node, &value);
-  EXPECT_TRUE(status.ok);
+  EXPECT_TRUE(EvalBoth(node, &value));
   EXPECT_EQ(ast::ValueType::BOOL, value.type());
   EXPECT_EQ(b, value.b());
 }
 
-void MatchDouble(ast::Node* node, double d) {
+void MatchDouble(const ast::Node* node, double d) {
   ast::Value value;
-  auto status = ast::Evaluator::eval(node, &value);
-  EXPECT_TRUE(status.ok);
+  EXPECT_TRUE(EvalBoth(node, &value));
   EXPECT_EQ(ast::ValueType::NUMBER, value.type());
   EXPECT_EQ(d, value.d());
 }
 
-void MatchString(ast::Node* node, std::string s) {
+void MatchString(const ast::Node* node, std::string s) {
   ast::Value value;
-  auto status = ast::Evaluator::eval(node, &value);
-  EXPECT_TRUE(status.ok);
+  EXPECT_TRUE(EvalBoth(node, &value));
   EXPECT_EQ(ast::ValueType::STRING, value.type());
   EXPECT_EQ(s, value.s());
 }
 
-void MatchError(ast::Node* node) {
+void MatchError(const ast::Node* node) {
   ast::Value value;
-  auto status = ast::Evaluator::eval(node, &value);
-  EXPECT_FALSE(status.ok);
+  EXPECT_FALSE(EvalBoth(node, &value));
 }
 
 TEST(Parser, Number) {
@@ -135,6 +177,25 @@ TEST(Parser, Bool) {
   }
 }
 
+TEST(Parser, Not) {
+  // Only nil and false are falsey.
+  const std::pair<std::string, bool> cases[] = {
+      {"!true", false}, {"!false", true}, {"!nil", true},
+      {"!0", false},    {"!\"s\"", false}, {"!!nil", false},
+  };
+  for (const auto& [expr, expected] : cases) {
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    MatchBool(parsed.get(), expected);
+  }
+  std::string expr = "!true";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  EXPECT_EQ("(! true)", ast::Printer::print(parser.parse().get()));
+}
+
 TEST(Parser, Nil) {
   {
     std::string expr = "nil";
@@ -179,6 +240,996 @@ TEST(Parser, ComplexTwo) {
   MatchDouble(parsed.get(), -2.0);
 }
 
+TEST(Parser, DeepTreeTeardown) {
+  // A left-deep chain of a million additions. Nodes are released in bulk
+  // with their arena, so dropping the tree does not recurse.
+  std::string expr = "1";
+  for (int i = 0; i < 1000000; ++i) expr += " + 1";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  {
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    EXPECT_TRUE(parsed);
+    EXPECT_GT(parsed.arena()->bytesReserved(), 1000000 * sizeof(ast::Binary));
+  }
+}
+
+TEST(Parser, DeepNesting) {
+  // A million levels of parentheses, prefix operators and right-nested
+  // binaries parse without recursing on the native stack, and neither do
+  // the engines, the printers and folding that walk the result.
+  constexpr int kDepth = 1000000;
+  std::string parens(kDepth, '(');
+  parens += "1" + std::string(kDepth, ')');
+  std::string negations(kDepth, '-');
+  negations += "1";
+  std::string right;
+  std::string rightPrinted;
+  for (int i = 0; i < kDepth; ++i) {
+    right += "1 + (";
+    rightPrinted += "(+ 1, ";
+  }
+  right += "1" + std::string(kDepth, ')');
+  rightPrinted += "1" + std::string(kDepth, ')');
+  std::string negationsPrinted;
+  for (int i = 0; i < kDepth; ++i) negationsPrinted += "(- ";
+  negationsPrinted += "1" + std::string(kDepth, ')');
+  const std::tuple<std::string, double, std::string> cases[] = {
+      {parens, 1.0, "1"},
+      {negations, 1.0, negationsPrinted},
+      {right, kDepth + 1.0, rightPrinted}};
+  for (const auto& [expr, expected, printed] : cases) {
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto flat = parser.parseFlat();
+    EXPECT_FALSE(err.hasErrors());
+    ASSERT_TRUE(flat);
+    ast::Value value;
+    ASSERT_TRUE(ast::Evaluator::eval(flat, &value).ok);
+    EXPECT_DOUBLE_EQ(expected, value.d());
+    EXPECT_EQ(printed, ast::Printer::print(flat));
+
+    Parser treeParser(&err, expr.begin(), expr.end());
+    auto parsed = treeParser.parse();
+    ASSERT_TRUE(parsed);
+    MatchDouble(parsed.get(), expected);
+    const jit::Program program(parsed.get());
+    ASSERT_TRUE(program.eval(&value).ok);
+    EXPECT_DOUBLE_EQ(expected, value.d());
+    EXPECT_EQ(printed, ast::Printer::print(parsed.get()));
+    // Folding reduces the whole tree to a single literal.
+    ast::Optimizer::foldConstants(&parsed);
+    ASSERT_EQ(ast::Node::Kind::NUMBER, parsed->kind);
+    EXPECT_DOUBLE_EQ(expected,
+                     static_cast<const ast::Number*>(parsed.get())->val);
+  }
+  {
+    // The innermost operator fails, after the JIT's guard has handed the
+    // whole chain back to the tree-walker.
+    const std::string expr = std::string(kDepth, '-') + "\"s\"";
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    ASSERT_TRUE(parsed);
+    ast::Value value;
+    EXPECT_FALSE(EvalBoth(parsed.get(), &value));
+    const jit::Program program(parsed.get());
+    const auto status = program.eval(&value);
+    EXPECT_FALSE(status.ok);
+    EXPECT_EQ("Unary '-' expects numeric argument", status.message);
+    EXPECT_EQ(kDepth - 1, status.token.location());
+  }
+  std::string unclosed = std::string(kDepth, '(') + "1";
+  ErrorReporter err(unclosed);
+  Parser parser(&err, unclosed.begin(), unclosed.end());
+  EXPECT_FALSE(parser.parseFlat());
+  ASSERT_EQ(1, err.numErrors());
+  EXPECT_EQ("Expecting right paren, found: ", err.error(0).msg);
+}
+
+TEST(Parser, LongConcatenations) {
+  // Pieces of varied lengths, some longer than a rope leaf, concatenated
+  // left to right and right to left by both engines.
+  std::string left = "\"\"";
+  std::string right = "\"\"";
+  std::string appended;
+  std::string prepended;
+  for (int i = 0; i < 3000; ++i) {
+    const std::string piece(i % 7 == 0 ? 300 : i % 5, 'a' + i % 26);
+    left += " + \"" + piece + "\"";
+    right = "\"" + piece + "\" + (" + right + ")";
+    appended += piece;
+    prepended = piece + prepended;
+  }
+  const std::pair<std::string, std::string> cases[] = {
+      {left, appended}, {right, prepended}};
+  for (const auto& [expr, expected] : cases) {
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    ASSERT_TRUE(parsed);
+    MatchString(parsed.get(), expected);
+    // Folded into a single string owned by the tree, without interning it
+    // or any of its prefixes.
+    const size_t interned = InternPool::global().size();
+    ast::Optimizer::foldConstants(&parsed);
+    EXPECT_EQ(interned, InternPool::global().size());
+    ASSERT_EQ(ast::Node::Kind::STRING, parsed->kind);
+    EXPECT_EQ(expected,
+              static_cast<const ast::String*>(parsed.get())->val.str());
+    EXPECT_GE(parsed.stringBytes(), expected.size());
+    MatchString(parsed.get(), expected);
+  }
+}
+
+TEST(Value, Ropes) {
+  constexpr int kPieces = 200000;
+  const ast::Value piece(std::string("0123456789"));
+  const ast::Value big(std::string(1000, 'x'));
+  auto pieceAt = [&](int i) -> const ast::Value& {
+    return i % 100 == 0 ? big : piece;
+  };
+  ast::Value appended{std::string()};
+  ast::Value prepended{std::string()};
+  ast::Value mixed{std::string()};
+  std::string flat;
+  for (int i = 0; i < kPieces; ++i) {
+    const ast::Value& p = pieceAt(i);
+    appended = ast::Value::concat(appended, p);
+    prepended = ast::Value::concat(pieceAt(kPieces - 1 - i), prepended);
+    mixed = i % 2 ? ast::Value::concat(mixed, p)
+                  : ast::Value::concat(p, mixed);
+    flat += p.s();
+  }
+  EXPECT_EQ(flat.size(), appended.length());
+  EXPECT_EQ(flat.size(), mixed.length());
+  // Compared without flattening either side first.
+  EXPECT_TRUE(appended.equals(prepended));
+  EXPECT_FALSE(appended.equals(mixed));
+  EXPECT_EQ(flat, appended.s());
+  EXPECT_TRUE(ast::Value(flat).equals(prepended));
+  EXPECT_FALSE(ast::Value(flat + "!").equals(mixed));
+  // Concatenating a flattened rope starts from its contents.
+  const ast::Value twice = ast::Value::concat(appended, appended);
+  EXPECT_EQ(flat + flat, twice.s());
+  EXPECT_EQ(flat, appended.s());
+  // Empty operands are returned as is.
+  EXPECT_TRUE(ast::Value::concat(big, ast::Value(std::string())).equals(big));
+}
+
+TEST(Parser, RuntimeErrors) {
+  {
+    std::string expr = "-\"abc\"";
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    MatchError(parsed.get());
+  }
+  {
+    std::string expr = "1 + (2 * \"abc\")";
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    MatchError(parsed.get());
+  }
+  {
+    std::string expr = "\"ab\" + \"cd\" == \"abcd\"";
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    EXPECT_FALSE(err.hasErrors());
+    MatchBool(parsed.get(), true);
+  }
+}
+
+TEST(Parser, ScansEachByteOnce) {
+  std::string expr = "1/2 + 1 > (3 + 5) == -4 <= 100 - 4*2  ";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto parsed = parser.parse();
+  EXPECT_FALSE(err.hasErrors());
+  EXPECT_TRUE(parsed);
+  const auto& scanner = parser.tokenStream().scanner();
+  EXPECT_EQ(expr.size(), scanner.bytesScanned());
+  EXPECT_EQ(21, scanner.tokensScanned());  // 20 tokens and EOF.
+}
+
+TEST(Parser, ConstantFolding) {
+  struct Case {
+    const char* expr;
+    const char* folded;
+  };
+  const Case cases[] = {
+      {"1 + 2 * 3", "7"},
+      {"1/2 + 1 > (3 + 5) == -4 <= 100 - 4*2", "false"},
+      {"-------2", "-2"},
+      {"\"ab\" + \"cd\" == \"abcd\"", "true"},
+      {"\"ab\" + \"cd\"", "'abcd'"},
+      {"!nil", "true"},
+      {"nil == nil", "true"},
+      // Subtrees that fail at run time stay, with their operands folded.
+      {"-\"str\"", "(- 'str')"},
+      {"1 + (2 * \"abc\")", "(+ 1, (* 2, 'abc'))"},
+      {"(1 + 2) * -(\"a\" + \"b\")", "(* 3, (- 'ab'))"},
+      {"-\"a\" + (1 + nil)", "(+ (- 'a'), (+ 1, nil))"},
+  };
+  for (const auto& c : cases) {
+    std::string expr = c.expr;
+    ErrorReporter err(expr);
+    Parser parser(&err, expr.begin(), expr.end());
+    auto parsed = parser.parse();
+    ASSERT_FALSE(err.hasErrors()) << expr;
+    ast::Value before;
+    auto beforeStatus = ast::Evaluator::eval(parsed.get(), &before);
+
+    ast::Optimizer::foldConstants(&parsed);
+    EXPECT_EQ(c.folded, ast::Printer::print(parsed.get())) << expr;
+    ast::Value after;
+    const bool ok = EvalBoth(parsed.get(), &after);
+    EXPECT_EQ(beforeStatus.ok, ok) << expr;
+    if (beforeStatus.ok && ok) {
+      EXPECT_TRUE(before.equals(after)) << expr;
+    } else {
+      auto afterStatus = ast::Evaluator::eval(parsed.get(), &after);
+      EXPECT_EQ(beforeStatus.message, afterStatus.message) << expr;
+      EXPECT_EQ(beforeStatus.token.location(),
+                afterStatus.token.location()) << expr;
+    }
+  }
+}
+
+TEST(Parser, FlatTree) {
+  // The flat encoding must print and evaluate exactly like the pointer tree.
+  const char* exprs[] = {
+      "123.5",
+      "\"abc\" + \"def\"",
+      "!nil == true",
+      "1/2 + 1 > (3 + 5) == -4 <= 100 - 4*2",
+      "-------2",
+      "1 + (2 * \"abc\")",
+      "-\"abc\"",
+  };
+  for (const char* e : exprs) {
+    std::string expr = e;
+    ErrorReporter err(expr);
+    Parser treeParser(&err, expr.begin(), expr.end());
+    auto tree = treeParser.parse();
+    Parser flatParser(&err, expr.begin(), expr.end());
+    auto flat = flatParser.parseFlat();
+    EXPECT_FALSE(err.hasErrors());
+    ASSERT_TRUE(tree);
+    ASSERT_TRUE(flat);
+    EXPECT_EQ(ast::Printer::print(tree.get()), ast::Printer::print(flat));
+    EXPECT_EQ(ast::Printer::print(tree.get(), true),
+              ast::Printer::print(flat, true));
+    ast::Value treeValue, flatValue;
+    auto treeStatus = ast::Evaluator::eval(tree.get(), &treeValue);
+    auto flatStatus = ast::Evaluator::eval(flat, &flatValue);
+    EXPECT_EQ(treeStatus.ok, flatStatus.ok) << expr;
+    if (treeStatus.ok && flatStatus.ok) {
+      EXPECT_TRUE(treeValue.equals(flatValue)) << expr;
+    } else {
+      EXPECT_EQ(treeStatus.message, flatStatus.message);
+      EXPECT_EQ(treeStatus.token.location(), flatStatus.token.location());
+      EXPECT_EQ(treeStatus.token.lexeme(), flatStatus.token.lexeme());
+    }
+  }
+}
+
+std::shared_ptr<Program> ParseProgram(const std::string& src) {
+  auto program = std::make_shared<Program>();
+  program->source = src;
+  ErrorReporter err(program->source);
+  Parser parser(&err, program->source.cbegin(), program->source.cend());
+  program->tree = parser.parse();
+  EXPECT_FALSE(err.hasErrors()) << src;
+  return program;
+}
+
+TEST(ProgramCache, HitsAndMisses) {
+  ProgramCache cache(1 << 20);
+  EXPECT_EQ(nullptr, cache.find("1 + 2"));
+  auto program = ParseProgram("1 + 2");
+  cache.insert(program);
+  cache.insert(ParseProgram("1 + 2"));  // already cached, dropped.
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(program, cache.find("1 + 2"));
+  EXPECT_EQ(nullptr, cache.find("1 + 3"));
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(2, cache.misses());
+
+  ProgramCache disabled(0);
+  disabled.insert(program);
+  EXPECT_EQ(nullptr, disabled.find("1 + 2"));
+  EXPECT_EQ(0, disabled.size());
+}
+
+TEST(ProgramCache, EvictsWithinBudget) {
+  const size_t programBytes = ParseProgram("0")->bytes();
+  // Room for about four programs, so inserting ten evicts some.
+  ProgramCache cache(programBytes * 5);
+  auto hot = ParseProgram("\"hot\"");
+  cache.insert(hot);
+  for (int i = 0; i < 10; ++i) {
+    // Referencing the hot program before every insert keeps the clock hand
+    // from ever evicting it.
+    EXPECT_EQ(hot, cache.find("\"hot\""));
+    cache.insert(ParseProgram(std::to_string(i)));
+    EXPECT_LE(cache.bytes(), cache.budget());
+    // No lookup is in flight, so nothing evicted is kept.
+    EXPECT_EQ(0, cache.retiredBytes());
+  }
+  EXPECT_LT(cache.size(), 11);
+  EXPECT_EQ(hot, cache.find("\"hot\""));
+  EXPECT_NE(nullptr, cache.find("9"));
+  EXPECT_EQ(nullptr, cache.find("0"));
+  // Evicted programs stay usable by whoever holds them.
+  ast::Value value;
+  EXPECT_TRUE(ast::Evaluator::eval(hot->tree.get(), &value).ok);
+  EXPECT_EQ("hot", value.s());
+}
+
+TEST(ProgramCache, ConcurrentReadersAndWriters) {
+  // A budget far smaller than the working set forces constant eviction
+  // while other threads look programs up.
+  ProgramCache cache(ParseProgram("0")->bytes() * 8, 16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t] {
+      for (int i = 0; i < 2000; ++i) {
+        const std::string src = std::to_string((i * 7 + t) % 64) + " * 2";
+        auto program = cache.find(src);
+        if (not program) {
+          program = ParseProgram(src);
+          cache.insert(program);
+        }
+        ast::Value value;
+        ASSERT_TRUE(ast::Evaluator::eval(program->tree.get(), &value).ok);
+        EXPECT_EQ(((i * 7 + t) % 64) * 2, value.d());
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(4 * 2000, cache.hits() + cache.misses());
+  EXPECT_LE(cache.bytes() + cache.retiredBytes(), cache.budget());
+}
+
+TEST(FlatTree, EncodeDecode) {
+  std::string expr = "!(\"a\" + \"bc\" == \"abc\") != (-1.5 * 2 < nil)";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto flat = parser.parseFlat();
+  ASSERT_TRUE(flat);
+  std::string encoded;
+  flat.encode(&encoded);
+  ast::FlatTree decoded;
+  ASSERT_TRUE(decoded.decode(encoded));
+  EXPECT_EQ(ast::Printer::print(flat, true),
+            ast::Printer::print(decoded, true));
+  EXPECT_EQ(ast::Printer::print(flat, true),
+            ast::Printer::print(decoded.toTree().get(), true));
+
+  // Damaged encodings either fail to decode or decode into a well-formed
+  // tree; they never yield one that the evaluator cannot walk.
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    for (char delta : {1, 0x40, -1}) {
+      std::string damaged = encoded;
+      damaged[i] += delta;
+      if (decoded.decode(damaged)) {
+        ast::Value value;
+        ast::Evaluator::eval(decoded, &value);
+      }
+    }
+    EXPECT_FALSE(decoded.decode(std::string_view(encoded).substr(0, i)));
+  }
+
+  // A tree with no nodes round-trips, and its consumers reject it rather
+  // than reading a root that is not there.
+  encoded.clear();
+  ast::FlatTree().encode(&encoded);
+  ASSERT_TRUE(decoded.decode(encoded));
+  EXPECT_TRUE(decoded.empty());
+  EXPECT_EQ("", ast::Printer::print(decoded));
+  ast::Value value;
+  const auto status = ast::Evaluator::eval(decoded, &value);
+  EXPECT_FALSE(status.ok);
+  EXPECT_EQ("Empty program", status.message);
+}
+
+TEST(DiskCache, StoreAndLoad) {
+  char dir[] = "/tmp/lox-cache-test.XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  DiskCache cache(std::string(dir) + "/cache");
+  std::string expr = "1 + 2 * \"x\"";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto flat = parser.parseFlat();
+  const DiskCache::Key key = DiskCache::key(expr);
+  ast::FlatTree loaded;
+  EXPECT_FALSE(cache.load(key, &loaded));
+  ASSERT_TRUE(cache.store(key, flat));
+  ASSERT_TRUE(cache.load(key, &loaded));
+  EXPECT_EQ(ast::Printer::print(flat), ast::Printer::print(loaded));
+  // Same length, different contents.
+  EXPECT_FALSE(cache.load(DiskCache::key("1 + 3 * \"x\""), &loaded));
+
+  // A corrupt entry is a miss, and storing again repairs it.
+  std::string data;
+  {
+    std::ifstream in(cache.path(key), std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  data[data.size() - 1] ^= 1;
+  std::ofstream(cache.path(key), std::ios::binary) << data;
+  EXPECT_FALSE(cache.load(key, &loaded));
+  std::ofstream(cache.path(key), std::ios::binary) << "LOXC";
+  EXPECT_FALSE(cache.load(key, &loaded));
+  ASSERT_TRUE(cache.store(key, flat));
+  EXPECT_TRUE(cache.load(key, &loaded));
+
+  std::remove(cache.path(key).c_str());
+  std::remove((std::string(dir) + "/cache").c_str());
+  std::remove(dir);
+}
+
+// Writes @src to a new temporary file and returns its path.
+std::string writeTemp(const std::string& src) {
+  char path[] = "/tmp/lox-engine-test.XXXXXX";
+  const int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  close(fd);
+  std::ofstream(path, std::ios::binary) << src;
+  return path;
+}
+
+// Returns what @run prints to std::cout.
+template <typename F>
+std::string captureStdout(F run) {
+  std::ostringstream out;
+  std::streambuf* old = std::cout.rdbuf(out.rdbuf());
+  run();
+  std::cout.rdbuf(old);
+  return out.str();
+}
+
+TEST(Stats, NestedTimers) {
+  using namespace std::chrono_literals;
+  Stats stats;
+  const auto start = std::chrono::steady_clock::now();
+  {
+    PhaseTimer parse(&stats, Stats::PARSE);
+    std::this_thread::sleep_for(10ms);
+    {
+      PhaseTimer scan(&stats, Stats::SCAN);
+      std::this_thread::sleep_for(10ms);
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  const auto& phases = stats.phases;
+  // The inner phase is taken out of the outer one, so that they add up to
+  // no more than the time they took together.
+  EXPECT_GE(phases[Stats::SCAN].wallSeconds, 0.01);
+  EXPECT_GE(phases[Stats::PARSE].wallSeconds, 0.01);
+  EXPECT_LE(phases[Stats::PARSE].wallSeconds +
+                phases[Stats::SCAN].wallSeconds,
+            elapsed);
+  EXPECT_EQ(nullptr, stats.timer);
+  // A null Stats is ignored.
+  { PhaseTimer timer(nullptr, Stats::EVAL); }
+
+  Stats merged;
+  merged.merge(stats);
+  merged.merge(stats);
+  EXPECT_DOUBLE_EQ(2 * phases[Stats::SCAN].wallSeconds,
+                   merged.phases[Stats::SCAN].wallSeconds);
+}
+
+TEST(Stats, CountsTokensAsParsed) {
+  // The parser stops at the second number, so the scanner never reaches,
+  // or reports, the unexpected characters after it.
+  const std::string expr = "1 2 @ #";
+  for (bool collect : {false, true}) {
+    Stats stats;
+    ErrorReporter err(expr);
+    {
+      PhaseTimer timer(&stats, Stats::PARSE);
+      Parser parser(&err, expr.begin(), expr.end());
+      if (collect) parser.tokenStream().setStats(&stats);
+      EXPECT_FALSE(parser.parse());
+    }
+    ASSERT_EQ(1, err.numErrors());
+    EXPECT_EQ(2, err.error(0).location);
+    EXPECT_EQ("Unexpected unparsed input at end", err.error(0).msg);
+    uint64_t tokens = 0;
+    for (uint64_t n : stats.tokens) tokens += n;
+    EXPECT_EQ(collect ? 2u : 0u, tokens);
+    EXPECT_EQ(tokens, stats.tokens[static_cast<size_t>(TokenType::NUMBER)]);
+  }
+
+  std::string sum = "0";
+  for (int i = 0; i < 10000; ++i) sum += " + " + std::to_string(i);
+  Stats stats;
+  ast::Tree tree;
+  {
+    PhaseTimer timer(&stats, Stats::PARSE);
+    ErrorReporter err(sum);
+    Parser parser(&err, sum.begin(), sum.end());
+    parser.tokenStream().setStats(&stats);
+    tree = parser.parse();
+  }
+  ASSERT_TRUE(tree);
+  EXPECT_EQ(10001u, stats.tokens[static_cast<size_t>(TokenType::NUMBER)]);
+  EXPECT_EQ(10000u, stats.tokens[static_cast<size_t>(TokenType::PLUS)]);
+  EXPECT_EQ(1u,
+            stats.tokens[static_cast<size_t>(TokenType::END_OF_FILE)]);
+  // Scanning is estimated from samples, as a share of the parse phase.
+  EXPECT_GT(stats.phases[Stats::SCAN].wallSeconds, 0);
+  EXPECT_GE(stats.phases[Stats::PARSE].wallSeconds, 0);
+  EXPECT_GE(stats.phases[Stats::PARSE].cpuSeconds, 0);
+
+  stats.countNodes(tree.get());
+  EXPECT_EQ(10001u, stats.nodes[static_cast<size_t>(ast::Node::Kind::NUMBER)]);
+  EXPECT_EQ(10000u, stats.nodes[static_cast<size_t>(ast::Node::Kind::BINARY)]);
+}
+
+TEST(LoxEngine, StatsDoNotChangeOutput) {
+  const std::string programs[] = {"1 + 2 * 3", "1 2 @ #", "-\"s\" + 1",
+                                  "!nil == true"};
+  for (const std::string& src : programs) {
+    const std::string path = writeTemp(src);
+    LoxEngine plain(LoxEngine::Options{});
+    const std::string expected =
+        captureStdout([&] { EXPECT_TRUE(plain.runFile(path.c_str())); });
+    EXPECT_EQ(0u, plain.stats().programs);
+    for (const char* name : {"ast", "vm"}) {
+      LoxEngine::Options options;
+      options.engine = name;
+      LoxEngine engine(options);
+      engine.setCollectStats(true);
+      EXPECT_EQ(expected, captureStdout([&] {
+                  EXPECT_TRUE(engine.runFile(path.c_str()));
+                })) << src;
+    }
+    std::remove(path.c_str());
+  }
+
+  LoxEngine engine(LoxEngine::Options{});
+  engine.setCollectStats(true);
+  const std::string path = writeTemp("(1 + 2) * -\"x\"");
+  EXPECT_EQ("Runtime error: msg=Unary '-' expects numeric argument, "
+            "location: 10\n",
+            captureStdout([&] { engine.runFile(path.c_str()); }));
+  std::remove(path.c_str());
+  const Stats& stats = engine.stats();
+  EXPECT_EQ(1u, stats.programs);
+  EXPECT_EQ(1u, stats.typeErrors);
+  // Every node is visited, although '*' is never applied.
+  EXPECT_EQ(6u, stats.evalVisits);
+  EXPECT_EQ(2u, stats.tokens[static_cast<size_t>(TokenType::NUMBER)]);
+  EXPECT_EQ(1u, stats.tokens[static_cast<size_t>(TokenType::STRING)]);
+  EXPECT_EQ(2u, stats.nodes[static_cast<size_t>(ast::Node::Kind::BINARY)]);
+  EXPECT_EQ(1u, stats.nodes[static_cast<size_t>(ast::Node::Kind::UNARY)]);
+  engine.resetStats();
+  EXPECT_EQ(0u, engine.stats().programs);
+}
+
+TEST(ThreadPool, RunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  ASSERT_EQ(4u, pool.size());
+  constexpr size_t kTasks = 10000;
+  std::vector<std::atomic<int>> runs(kTasks);
+  std::vector<std::atomic<bool>> busy(pool.size());
+  std::atomic<bool> overlapped{false};
+  pool.parallelFor(kTasks, [&](size_t task, size_t worker) {
+    ASSERT_LT(worker, pool.size());
+    // No two tasks of the same worker run at once.
+    if (busy[worker].exchange(true)) overlapped = true;
+    ++runs[task];
+    busy[worker] = false;
+  });
+  EXPECT_FALSE(overlapped);
+  for (size_t i = 0; i < kTasks; ++i) EXPECT_EQ(1, runs[i]) << i;
+}
+
+TEST(ThreadPool, StealsFromSlowWorkers) {
+  using namespace std::chrono_literals;
+  ThreadPool pool(4);
+  // Every slow task lies in the range handed to worker 0 at first, so the
+  // others can only help by stealing from it.
+  constexpr size_t kTasks = 64;
+  constexpr size_t kSlow = kTasks / 4;
+  std::vector<size_t> ranBy(kTasks);
+  pool.parallelFor(kTasks, [&](size_t task, size_t worker) {
+    if (task < kSlow) std::this_thread::sleep_for(5ms);
+    ranBy[task] = worker;
+  });
+  size_t stolen = 0;
+  for (size_t i = 0; i < kSlow; ++i) stolen += ranBy[i] != ranBy[0];
+  EXPECT_GT(stolen, 0u);
+}
+
+TEST(ThreadPool, ReusedAcrossBatches) {
+  ThreadPool pool(3);
+  for (size_t n : {0, 1, 2, 3, 7, 100, 0, 1000, 5}) {
+    std::vector<size_t> values(n);
+    pool.parallelFor(n, [&](size_t task, size_t) { values[task] = task + 1; });
+    for (size_t i = 0; i < n; ++i) EXPECT_EQ(i + 1, values[i]);
+  }
+  // A single worker runs everything inline, in order.
+  ThreadPool serial(1);
+  std::vector<size_t> order;
+  serial.parallelFor(10, [&](size_t task, size_t worker) {
+    EXPECT_EQ(0u, worker);
+    order.push_back(task);
+  });
+  for (size_t i = 0; i < order.size(); ++i) EXPECT_EQ(i, order[i]);
+  EXPECT_EQ(10u, order.size());
+}
+
+TEST(LoxEngine, BatchOutputInInputOrder) {
+  // Enough lines for several windows of blocks per worker, with programs of
+  // uneven cost and some that fail.
+  std::string src;
+  std::string expected;
+  for (int i = 0; i < 100000; ++i) {
+    if (i % 1000 == 999) {
+      src += "-\"s\"\n";
+      expected += "Runtime error: msg=Unary '-' expects numeric argument, "
+                  "location: 0\n";
+    } else if (i % 7 == 0) {
+      src += std::string(100, '(') + std::to_string(i) +
+             std::string(100, ')') + "\n";
+      expected += std::to_string(i) + "\n";
+    } else {
+      src += std::to_string(i) + " + 0\n";
+      expected += std::to_string(i) + "\n";
+    }
+  }
+  const std::string path = writeTemp(src);
+  for (size_t cacheBytes : {0, 1 << 20}) {
+    LoxEngine::Options options;
+    options.cacheBytes = cacheBytes;
+    LoxEngine engine(options);
+    engine.setCollectStats(true);
+    EXPECT_EQ(expected, captureStdout([&] {
+                EXPECT_TRUE(engine.runBatch(path.c_str(), 4));
+              }));
+    EXPECT_EQ(100000u, engine.stats().programs);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(Trace, PhasesAndSampledVisits) {
+  char path[] = "/tmp/lox-trace-test.XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  trace::start(1);
+  std::string expr = "1 + -2";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto tree = parser.parse();
+  ast::Value value;
+  {
+    PhaseTimer timer(nullptr, Stats::EVAL);
+    ASSERT_TRUE(ast::Evaluator::eval(tree.get(), &value).ok);
+  }
+  std::thread([] { trace::Span span("other thread"); }).join();
+  ASSERT_TRUE(trace::write(path));
+  EXPECT_FALSE(trace::enabled());
+  std::ifstream in(path);
+  const std::string json((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  std::remove(path);
+  EXPECT_EQ(0, json.find("{\"displayTimeUnit\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"eval\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"other thread\""));
+  // Every node is sampled, operators with their offsets.
+  EXPECT_NE(std::string::npos,
+            json.find("\"name\":\"Binary\",\"cat\":\"lox\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"offset\":2}"));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"offset\":4}"));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"Number\""));
+}
+
+TEST(Profile, FoldsSourceStacks) {
+  // Two balanced halves joined by a '*' at the start of line 2, which is
+  // therefore the outermost frame of every sample taken while evaluating.
+  std::vector<std::string> level(1 << 12, "2");
+  for (int depth = 0; level.size() > 2; ++depth) {
+    std::vector<std::string> next;
+    for (size_t i = 0; i < level.size(); i += 2) {
+      next.push_back("(" + level[i] + (depth % 2 ? " - " : " + ") +
+                     level[i + 1] + ")");
+    }
+    level.swap(next);
+  }
+  const std::string expr = level[0] + "\n* " + level[1];
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto tree = parser.parse();
+  ASSERT_FALSE(err.hasErrors());
+  char path[] = "/tmp/lox-profile-test.XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(profile::start(10000));
+  EXPECT_TRUE(profile::active());
+  for (int i = 0; i < 100000 && profile::samples() < 20; ++i) {
+    ast::Value value;
+    ASSERT_TRUE(ast::Evaluator::eval(tree.get(), &value).ok);
+  }
+  profile::stop();
+  EXPECT_FALSE(profile::active());
+  EXPECT_GE(profile::samples(), 20);
+  ASSERT_TRUE(profile::write(path, err));
+  std::ifstream in(path);
+  std::string line;
+  uint64_t total = 0;
+  while (std::getline(in, line)) {
+    const size_t space = line.rfind(' ');
+    ASSERT_NE(std::string::npos, space) << line;
+    total += std::stoull(line.substr(space + 1));
+    if (line.compare(0, 13, "[interpreter]") == 0) continue;
+    EXPECT_EQ(0, line.find("2:1 *")) << line;
+  }
+  std::remove(path);
+  EXPECT_EQ(profile::samples(), total);
+}
+
+// Random expression over all operators, mostly arithmetic on numbers so
+// that large native subtrees form, with the occasional operand of another
+// type to exercise the type guard.
+std::string RandomExpr(std::mt19937* rng, int depth) {
+  std::uniform_int_distribution<int> pick(0, 99);
+  const int p = pick(*rng);
+  if (depth == 0 || p < 15) {
+    static const char* const kOthers[] = {"\"s\"", "true", "nil", "0"};
+    if (p < 3) return kOthers[p];
+    std::uniform_real_distribution<double> number(0, 100);
+    return std::to_string(number(*rng));
+  }
+  if (p < 25) return "-" + RandomExpr(rng, depth - 1);
+  if (p < 28) return "!" + RandomExpr(rng, depth - 1);
+  static const char* const kOps[] = {" + ", " - ", " * ", " / ", " < ",
+                                     " == "};
+  const char* op = kOps[p < 92 ? p % 4 : 4 + p % 2];
+  return "(" + RandomExpr(rng, depth - 1) + op + RandomExpr(rng, depth - 1) +
+         ")";
+}
+
+void ExpectSameAsEvaluator(const std::string& expr) {
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto tree = parser.parse();
+  ASSERT_FALSE(err.hasErrors()) << expr;
+  ast::Value expected, actual;
+  auto expectedStatus = ast::Evaluator::eval(tree.get(), &expected);
+  jit::Program program(tree.get());
+  auto actualStatus = program.eval(&actual);
+  ASSERT_EQ(expectedStatus.ok, actualStatus.ok) << expr;
+  if (not expectedStatus.ok) {
+    EXPECT_EQ(expectedStatus.message, actualStatus.message) << expr;
+    EXPECT_EQ(expectedStatus.token.location(),
+              actualStatus.token.location()) << expr;
+  } else if (expected.type() == ast::ValueType::NUMBER &&
+             std::isnan(expected.d())) {
+    EXPECT_TRUE(actual.type() == ast::ValueType::NUMBER &&
+                std::isnan(actual.d())) << expr;
+  } else {
+    EXPECT_EQ(expected.type(), actual.type()) << expr;
+    EXPECT_TRUE(expected.equals(actual)) << expr;
+  }
+}
+
+TEST(Jit, MatchesEvaluator) {
+  std::mt19937 rng(2024);
+  for (int i = 0; i < 2000; ++i) {
+    ExpectSameAsEvaluator(RandomExpr(&rng, 1 + i % 8));
+  }
+}
+
+TEST(Jit, CompilesArithmetic) {
+  std::string expr = "(1.5 * 2 + 3) / 4 - -1 == 5 / 2";
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  auto tree = parser.parse();
+  jit::Program program(tree.get());
+  if (jit::Program::supported()) {
+    EXPECT_EQ(2, program.numRegions());
+    EXPECT_GT(program.codeSize(), 0);
+  }
+  ast::Value value;
+  ASSERT_TRUE(program.eval(&value).ok);
+  EXPECT_TRUE(value.b());
+  ExpectSameAsEvaluator(expr);
+  // Guards fail on the string, and on the nil in the second operand.
+  ExpectSameAsEvaluator("1 + 2 * (\"a\" + \"b\")");
+  ExpectSameAsEvaluator("1 + 2 * (3 < 4) - (nil < 1)");
+}
+
+TEST(Jit, ManyRegisters) {
+  // A balanced tree of 2^17 leaves needs more than the 16 xmm registers,
+  // so it is compiled as several smaller functions.
+  std::vector<std::string> level(1 << 17);
+  for (size_t i = 0; i < level.size(); ++i) {
+    level[i] = std::to_string(i % 7 + 1);
+  }
+  const char* const kOps[] = {" + ", " * ", " - ", " / "};
+  for (int depth = 0; level.size() > 1; ++depth) {
+    std::vector<std::string> next;
+    for (size_t i = 0; i < level.size(); i += 2) {
+      next.push_back("(" + level[i] + kOps[depth % 4] + level[i + 1] + ")");
+    }
+    level.swap(next);
+  }
+  ExpectSameAsEvaluator(level[0]);
+}
+
+// Random well-typed expression over the number inputs X and Y and the bool
+// inputs F and G. @number selects the type of the result.
+std::string RandomColumnExpr(std::mt19937* rng, int depth, bool number) {
+  std::uniform_int_distribution<int> pick(0, 99);
+  const int p = pick(*rng);
+  if (number) {
+    if (depth == 0 || p < 20) {
+      if (p < 8) return p % 2 ? "X" : "Y";
+      return std::to_string(p % 7) + ".5";
+    }
+    if (p < 30) return "-" + RandomColumnExpr(rng, depth - 1, true);
+    static const char* const kOps[] = {" + ", " - ", " * ", " / "};
+    return "(" + RandomColumnExpr(rng, depth - 1, true) + kOps[p % 4] +
+           RandomColumnExpr(rng, depth - 1, true) + ")";
+  }
+  if (depth == 0 || p < 15) {
+    static const char* const kBools[] = {"F", "G", "true", "false"};
+    return kBools[p % 4];
+  }
+  if (p < 25) return "!" + RandomColumnExpr(rng, depth - 1, p % 3 == 0);
+  if (p < 40) {
+    return "(" + RandomColumnExpr(rng, depth - 1, false) +
+           (p % 2 ? " == " : " != ") +
+           RandomColumnExpr(rng, depth - 1, p % 5 == 0) + ")";
+  }
+  static const char* const kOps[] = {" == ", " != ", " < ", " <= ", " > ",
+                                     " >= "};
+  return "(" + RandomColumnExpr(rng, depth - 1, true) + kOps[p % 6] +
+         RandomColumnExpr(rng, depth - 1, true) + ")";
+}
+
+// Replaces the inputs in @expr by their values in one row.
+std::string SubstituteRow(const std::string& expr, double x, double y,
+                          bool f, bool g) {
+  std::string out;
+  for (char c : expr) {
+    char buf[64];
+    if (c == 'X' || c == 'Y') {
+      std::snprintf(buf, sizeof(buf), "(%.17g)", c == 'X' ? x : y);
+      out += buf;
+    } else if (c == 'F' || c == 'G') {
+      out += (c == 'F' ? f : g) ? "true" : "false";
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+TEST(Column, MatchesEvaluator) {
+  // Not a multiple of the batch sizes, nor of 64.
+  const size_t kRows = 1500;
+  std::mt19937 rng(2025);
+  std::uniform_int_distribution<int> value(-8, 8);
+  std::vector<double> xs(kRows), ys(kRows);
+  column::Bitmap fs(kRows), gs(kRows);
+  for (size_t i = 0; i < kRows; ++i) {
+    // Quarters are exact, and zeros exercise division by zero.
+    xs[i] = value(rng) / 4.0;
+    ys[i] = value(rng) / 4.0;
+    fs.set(i, value(rng) > 0);
+    gs.set(i, value(rng) % 2 == 0);
+  }
+  const std::vector<column::Input> inputs = {
+      {"X", column::Type::NUMBER},
+      {"Y", column::Type::NUMBER},
+      {"F", column::Type::BOOL},
+      {"G", column::Type::BOOL}};
+  for (int i = 0; i < 100; ++i) {
+    const bool number = i % 2 == 0;
+    const std::string expr = RandomColumnExpr(&rng, 1 + i % 6, number);
+    std::vector<ast::Value> expected(kRows);
+    for (size_t row = 0; row < kRows; ++row) {
+      const std::string text =
+          SubstituteRow(expr, xs[row], ys[row], fs.test(row), gs.test(row));
+      ErrorReporter err(text);
+      Parser parser(&err, text.begin(), text.end());
+      auto tree = parser.parse();
+      ASSERT_FALSE(err.hasErrors()) << text;
+      ASSERT_TRUE(ast::Evaluator::eval(tree.get(), &expected[row]).ok);
+    }
+    ErrorReporter err(expr);
+    column::Program program;
+    ASSERT_TRUE(program.compile(expr, inputs, &err)) << expr;
+    ASSERT_EQ(number ? column::Type::NUMBER : column::Type::BOOL,
+              program.type()) << expr;
+    for (auto level : {simd::Level::GENERIC, simd::Level::AVX2}) {
+      for (size_t batch : {size_t{1024}, size_t{4096}}) {
+        program.setLevel(level);
+        program.setBatchSize(batch);
+        if (number) {
+          std::vector<double> out;
+          ASSERT_TRUE(program.eval({xs, ys, fs, gs}, &out));
+          ASSERT_EQ(kRows, out.size());
+          for (size_t row = 0; row < kRows; ++row) {
+            if (std::isnan(expected[row].d())) {
+              EXPECT_TRUE(std::isnan(out[row])) << expr << " @" << row;
+            } else {
+              EXPECT_EQ(expected[row].d(), out[row]) << expr << " @" << row;
+            }
+          }
+        } else {
+          column::Bitmap out;
+          ASSERT_TRUE(program.eval({xs, ys, fs, gs}, &out));
+          ASSERT_EQ(kRows, out.size());
+          size_t count = 0;
+          for (size_t row = 0; row < kRows; ++row) {
+            EXPECT_EQ(expected[row].b(), out.test(row)) << expr << " @" << row;
+            count += expected[row].b();
+          }
+          EXPECT_EQ(count, out.count()) << expr;
+        }
+      }
+    }
+  }
+}
+
+TEST(Column, Errors) {
+  const std::vector<column::Input> inputs = {{"x", column::Type::NUMBER},
+                                             {"f", column::Type::BOOL}};
+  auto compileError = [&inputs](const std::string& expr) {
+    ErrorReporter err(expr);
+    column::Program program;
+    EXPECT_FALSE(program.compile(expr, inputs, &err)) << expr;
+    EXPECT_TRUE(err.hasErrors()) << expr;
+    return err.hasErrors() ? err.error(0) : ErrorReporter::Error{};
+  };
+  auto error = compileError("x + z");
+  EXPECT_EQ(4, error.location);
+  EXPECT_EQ("Undefined input: z", error.msg);
+  error = compileError("1 + f");
+  EXPECT_EQ(2, error.location);
+  EXPECT_EQ(compileError("1 + true").msg, error.msg);
+  error = compileError("-(f)");
+  EXPECT_EQ(0, error.location);
+  compileError("x < \"a\"");
+  compileError("\"a\" + \"b\"");
+  compileError("nil");
+  compileError("x +");
+  // Strings and nil may still meet inputs in equality, or be folded.
+  ErrorReporter err("");
+  column::Program program;
+  EXPECT_TRUE(program.compile("(\"a\" + \"b\" == \"ab\") == (x != nil)",
+                              inputs, &err));
+  EXPECT_EQ(column::Type::BOOL, program.type());
+  std::vector<double> xs = {1, 2, 3};
+  column::Bitmap fs(3);
+  column::Bitmap out;
+  ASSERT_TRUE(program.eval({xs, fs}, &out));
+  EXPECT_EQ(3, out.count());
+  // Mismatched columns are rejected.
+  std::vector<double> numbers;
+  EXPECT_FALSE(program.eval({xs, fs}, &numbers));
+  EXPECT_FALSE(program.eval({xs}, &out));
+  EXPECT_FALSE(program.eval({fs, xs}, &out));
+  std::vector<double> shorter = {1, 2};
+  EXPECT_FALSE(program.eval({shorter, fs}, &out));
+}
+
 }  // namespace lox
 
 int main(int argc, char** argv) {
@@ -1,18 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <fmt/format.h>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "ast.hpp"
 #include "error-reporter.hpp"
-#include "scanner.hpp"
+#include "flat-ast.hpp"
+#include "intern.hpp"
+#include "token-stream.hpp"
 #include "token.hpp"
 #include "token-type.hpp"
 
 namespace lox {
 
-// This class implements a recursive descent parser that will parse the
-// following grammar.
+namespace internal {
+
+// Binding power of each binary operator token; 0 for tokens that are not
+// binary operators. Prefix operators bind tighter than any binary one.
+enum Precedence : uint8_t {
+  kNone = 0,
+  kEquality,
+  kComparison,
+  kAddition,
+  kMultiplication,
+  kUnary,
+};
+
+struct BinaryOperator {
+  uint8_t precedence = kNone;
+  ast::Binary::Operator op = ast::Binary::MINUS;
+};
+
+constexpr std::array<BinaryOperator, 256> makeBinaryOperators() {
+  std::array<BinaryOperator, 256> t{};
+  auto set = [&t](TokenType type, Precedence p, ast::Binary::Operator op) {
+    t[static_cast<uint8_t>(type)] = BinaryOperator{p, op};
+  };
+  set(TokenType::BANG_EQUAL, kEquality, ast::Binary::BANG_EQUAL);
+  set(TokenType::EQUAL_EQUAL, kEquality, ast::Binary::EQUAL_EQUAL);
+  set(TokenType::GREATER, kComparison, ast::Binary::GREATER);
+  set(TokenType::GREATER_EQUAL, kComparison, ast::Binary::GREATER_EQUAL);
+  set(TokenType::LESS, kComparison, ast::Binary::LESS);
+  set(TokenType::LESS_EQUAL, kComparison, ast::Binary::LESS_EQUAL);
+  set(TokenType::MINUS, kAddition, ast::Binary::MINUS);
+  set(TokenType::PLUS, kAddition, ast::Binary::PLUS);
+  set(TokenType::SLASH, kMultiplication, ast::Binary::SLASH);
+  set(TokenType::STAR, kMultiplication, ast::Binary::STAR);
+  return t;
+}
+
+inline constexpr std::array<BinaryOperator, 256> kBinaryOperators =
+    makeBinaryOperators();
+
+inline const BinaryOperator& binaryOperator(TokenType type) {
+  return kBinaryOperators[static_cast<uint8_t>(type)];
+}
+
+// Whether Builder accepts identifiers, through a method
+//   Ref identifier(const Token& token);
+// The language itself has no variables, so only builders that bind names
+// to something of their own, such as column::Program inputs, define it.
+template <typename Builder, typename = void>
+struct HasIdentifier : std::false_type {};
+template <typename Builder>
+struct HasIdentifier<Builder,
+                     std::void_t<decltype(std::declval<Builder&>().identifier(
+                         std::declval<const Token&>()))>> : std::true_type {};
+
+}  // namespace internal
+
+// This class implements a precedence climbing parser for the following
+// grammar.
 //
 // expression     -> equality
 // equality       -> comparison ( ( "!=" | "==" ) comparison )*
@@ -21,193 +88,175 @@ namespace lox {
 // multiplication -> unary ( ( "/" | "*" ) unary )*
 // unary          -> (( "!" | "-" ) unary) | primary
 // primary        -> NUMBER | STRING | FALSE | TRUE | NIL | "(" expression ")"
+//
+// Builders that bind identifiers also accept IDENTIFIER as a primary.
+//
+// Rather than one function per precedence level, binary operators are
+// looked up in a table keyed by TokenType, and pending operators and
+// operands live on explicit stacks instead of the native one. Parsing
+// therefore needs no recursion, however deeply the input nests.
 template <typename Iterator> class Parser {
  public:
   Parser(ErrorReporter* err, Iterator begin, Iterator end)
-    : err_(err), s_(err, begin, end) {}
+    : err_(err), tokens_(err, begin, end) {}
 
-  std::unique_ptr<ast::Node> parse() {
+  // Parses the whole input into a pointer-linked tree. On failure the
+  // errors are recorded in the ErrorReporter and the returned tree is empty.
+  ast::Tree parse() {
+    ast::TreeBuilder builder;
+    return parseWith(&builder);
+  }
+  // Same as parse(), but emits the flat post-order form of the tree.
+  ast::FlatTree parseFlat() {
+    ast::FlatBuilder builder;
+    return parseWith(&builder);
+  }
+  // Parses the whole input with a custom Builder that assembles the result;
+  // see ast::TreeBuilder for the interface. Builders may additionally bind
+  // identifiers, see internal::HasIdentifier.
+  template <typename Builder>
+  typename Builder::Result parseWith(Builder* b) {
     try {
-      auto node = parseExpression();
-      if (not s_.done()) {
-        err_->report(s_.currLocation(), "Unexpected unparsed input at end");
-        return nullptr;
+      auto node = parseExpression(b);
+      if (tokens_.peek().type() != TokenType::END_OF_FILE) {
+        err_->report(tokens_.peek().location(),
+                     "Unexpected unparsed input at end");
+        return {};
       }
-      return node;
+      return b->finish(node);
     } catch (ErrorReporter::Error err) {
       err_->report(err.location, err.msg);
     }
-    return nullptr;
+    return {};
   }
+  // The token stream being parsed, e.g. to inspect the scanner's counters
+  // or to collect Stats.
+  const TokenStream<Iterator>& tokenStream() const { return tokens_; }
+  TokenStream<Iterator>& tokenStream() { return tokens_; }
 
  private:
-  std::unique_ptr<ast::Node> parseExpression() { return parseEquality(); }
-  std::unique_ptr<ast::Node> parseEquality() {
-    auto node = parseComparison();
+  // An operator waiting for its right operand, or an open parenthesis.
+  struct Pending {
+    enum Kind : uint8_t { UNARY, BINARY, PAREN };
+    Kind kind;
+    uint8_t precedence;
+    Token token;
+  };
+
+  template <typename B> typename B::Ref parseExpression(B* b) {
+    std::vector<typename B::Ref> operands;
+    std::vector<Pending> pending;
     while (true) {
-      auto token = s_.next();
-      if (token.type() == TokenType::END_OF_FILE) break;
-      auto binary = std::make_unique<ast::Binary>();
+      // Prefix position: any number of unary operators and open
+      // parentheses, followed by a literal.
+      const Token token = tokens_.advance();
       switch (token.type()) {
-        case TokenType::BANG_EQUAL:
-          binary->op = ast::Binary::BANG_EQUAL;
-          binary->opToken = token;
-          break;
-        case TokenType::EQUAL_EQUAL:
-          binary->op = ast::Binary::EQUAL_EQUAL;
-          binary->opToken = token;
-          break;
+        case TokenType::BANG:
+        case TokenType::MINUS:
+          pending.push_back({Pending::UNARY, internal::kUnary, token});
+          continue;
+        case TokenType::LEFT_PAREN:
+          pending.push_back({Pending::PAREN, internal::kNone, token});
+          continue;
         default:
-          s_.rewind();
-          return node;
-      }
-      binary->first = std::move(node);
-      binary->second = parseComparison();
-      node = std::move(binary);
-    }
-    return node;
-  }
-  std::unique_ptr<ast::Node> parseComparison() {
-    auto node = parseAddition();
-    while (true) {
-      auto token = s_.next();
-      if (token.type() == TokenType::END_OF_FILE) break;
-      auto binary = std::make_unique<ast::Binary>();
-      switch (token.type()) {
-        case TokenType::GREATER:
-          binary->op = ast::Binary::GREATER;
-          binary->opToken = token;
-          break;
-        case TokenType::GREATER_EQUAL:
-          binary->op = ast::Binary::GREATER_EQUAL;
-          binary->opToken = token;
-          break;
-        case TokenType::LESS:
-          binary->op = ast::Binary::LESS;
-          binary->opToken = token;
+          operands.push_back(parsePrimary(b, token));
           break;
-        case TokenType::LESS_EQUAL:
-          binary->op = ast::Binary::LESS_EQUAL;
-          binary->opToken = token;
-          break;
-        default:
-          s_.rewind();
-          return node;
       }
-      binary->first = std::move(node);
-      binary->second = parseAddition();
-      node = std::move(binary);
-    }
-    return node;
-  }
-  std::unique_ptr<ast::Node> parseAddition() {
-    auto node = parseMultiplication();
-    while (true) {
-      auto token = s_.next();
-      if (token.type() == TokenType::END_OF_FILE) break;
-      auto binary = std::make_unique<ast::Binary>();
-      switch (token.type()) {
-        case TokenType::MINUS:
-          binary->op = ast::Binary::MINUS;
-          binary->opToken = token;
+      // Infix position: close parentheses, then either continue with a
+      // binary operator or stop at the end of the expression.
+      while (true) {
+        const Token& next = tokens_.peek();
+        const auto& binary = internal::binaryOperator(next.type());
+        if (binary.precedence != internal::kNone) {
+          // Operators are left associative: reduce everything that binds
+          // at least as tightly before pushing this one.
+          reduce(b, &operands, &pending, binary.precedence);
+          pending.push_back(
+              {Pending::BINARY, binary.precedence, tokens_.advance()});
           break;
-        case TokenType::PLUS:
-          binary->op = ast::Binary::PLUS;
-          binary->opToken = token;
-          break;
-        default:
-          s_.rewind();
-          return node;
+        }
+        reduce(b, &operands, &pending, internal::kEquality);
+        if (pending.empty()) return operands.back();
+        // Only an open parenthesis can be left at this point.
+        const Token close = tokens_.advance();
+        if (close.type() != TokenType::RIGHT_PAREN) {
+          throw ErrorReporter::Error{
+              close.location(), fmt::format("Expecting right paren, found: {}",
+                                            close.lexeme())};
+        }
+        pending.pop_back();
       }
-      binary->first = std::move(node);
-      binary->second = parseMultiplication();
-      node = std::move(binary);
     }
-    return node;
   }
-  std::unique_ptr<ast::Node> parseMultiplication() {
-    auto node = parseUnary();
-    while (true) {
-      auto token = s_.next();
-      if (token.type() == TokenType::END_OF_FILE) break;
-      auto binary = std::make_unique<ast::Binary>();
-      switch (token.type()) {
-        case TokenType::SLASH:
-          binary->op = ast::Binary::SLASH;
-          binary->opToken = token;
-          break;
-        case TokenType::STAR:
-          binary->op = ast::Binary::STAR;
-          binary->opToken = token;
-          break;
-        default:
-          s_.rewind();
-          return node;
+  // Applies pending operators binding at least as tightly as @precedence,
+  // stopping at an open parenthesis.
+  template <typename B>
+  void reduce(B* b, std::vector<typename B::Ref>* operands,
+              std::vector<Pending>* pending, uint8_t precedence) {
+    while (not pending->empty() && pending->back().kind != Pending::PAREN &&
+           pending->back().precedence >= precedence) {
+      const Pending top = pending->back();
+      pending->pop_back();
+      if (top.kind == Pending::UNARY) {
+        const auto op = top.token.type() == TokenType::BANG
+                            ? ast::Unary::BANG
+                            : ast::Unary::MINUS;
+        operands->back() = b->unary(op, top.token, operands->back());
+      } else {
+        const auto second = operands->back();
+        operands->pop_back();
+        operands->back() = b->binary(
+            internal::binaryOperator(top.token.type()).op, top.token,
+            operands->back(), second);
       }
-      binary->first = std::move(node);
-      binary->second = parseUnary();
-      node = std::move(binary);
-    }
-    return node;
-  }
-  std::unique_ptr<ast::Node> parseUnary() {
-    auto token = s_.next();
-    if (token.type() == TokenType::BANG || token.type() == TokenType::MINUS) {
-      auto unary = std::make_unique<ast::Unary>();
-      unary->op = token.type() == TokenType::BANG ? ast::Unary::BANG :
-                                                    ast::Unary::MINUS;
-      unary->opToken = token;
-      unary->operand = parseUnary();
-      return unary;
     }
-    s_.rewind();  // return the last token back to the scanner.
-    return parsePrimary();
   }
-  std::unique_ptr<ast::Node> parsePrimary() {
-    auto token = s_.next();
+  template <typename B>
+  typename B::Ref parsePrimary(B* b, const Token& token) {
     if (token.type() == TokenType::NUMBER) {
-      auto number = std::make_unique<ast::Number>();
-      try {
-        number->val = std::stod(token.lexeme());
-      } catch (...) {
+      double val;
+      if (not parseNumber(token.lexeme(), &val)) {
         throw ErrorReporter::Error{
             token.location(),
             fmt::format("Invalid numeric literal: {}", token.lexeme())};
       }
-      return number;
+      return b->number(val);
     }
     if (token.type() == TokenType::STRING) {
-      auto str = std::make_unique<ast::String>();
-      str->val = token.lexeme();
-      return str;
+      return b->string(intern(token.lexeme()));
     }
-    if (token.type() == TokenType::FALSE) {
-      auto boolean = std::make_unique<ast::Bool>();
-      boolean->val = false;
-      return boolean;
-    }
-    if (token.type() == TokenType::TRUE) {
-      auto boolean = std::make_unique<ast::Bool>();
-      boolean->val = true;
-      return boolean;
-    }
-    if (token.type() == TokenType::NIL) return std::make_unique<ast::Nil>();
-    if (token.type() == TokenType::LEFT_PAREN) {
-      auto expr = parseExpression();
-      token = s_.next();  // consume closing ')'
-      if (token.type() != TokenType::RIGHT_PAREN) {
-        throw ErrorReporter::Error{
-            token.location(),
-            fmt::format("Expecting right paren, found: {}", token.lexeme())};
-      }
-      return expr;
+    if (token.type() == TokenType::FALSE) return b->boolean(false);
+    if (token.type() == TokenType::TRUE) return b->boolean(true);
+    if (token.type() == TokenType::NIL) return b->nil();
+    if constexpr (internal::HasIdentifier<B>::value) {
+      if (token.type() == TokenType::IDENTIFIER) return b->identifier(token);
     }
     throw ErrorReporter::Error{
         token.location(),
         fmt::format("Unexpected token: {}", token.debugString())};
   }
+
+  // Converts a numeric lexeme to a double. Lexemes are not NUL terminated,
+  // so they are copied into a terminated buffer before conversion.
+  static bool parseNumber(std::string_view lexeme, double* out) {
+    char buf[64];
+    std::string str;
+    const char* begin = buf;
+    if (lexeme.size() < sizeof(buf)) {
+      lexeme.copy(buf, lexeme.size());
+      buf[lexeme.size()] = '\0';
+    } else {
+      str.assign(lexeme);
+      begin = str.c_str();
+    }
+    char* end = nullptr;
+    errno = 0;
+    *out = std::strtod(begin, &end);
+    return errno != ERANGE && end == begin + lexeme.size();
+  }
+
   ErrorReporter* err_;
-  Scanner<Iterator> s_;
+  TokenStream<Iterator> tokens_;
 };
 
 }  // namespace lox
@@ -0,0 +1,168 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ast-eval.hpp"
+#include "ast-printer.hpp"
+#include "error-reporter.hpp"
+#include "parser.hpp"
+#include "program-gen.hpp"
+#include "scanner.hpp"
+
+// Throughput of each phase of the interpreter on synthetic programs:
+// Scanner::next, Parser::parse, Evaluator::eval and Printer::print. Every
+// benchmark reports its rate in source bytes, tokens and syntax tree nodes
+// per second, so phases can be compared with each other and over time.
+//
+// Results are written as JSON unless another --benchmark_format is given,
+// e.g. to keep a history:
+//   pipeline-bench --benchmark_out=results.json
+
+namespace lox {
+namespace {
+
+// Operator mixes; see ProgramShape.
+enum Mix { ARITHMETIC, LOGIC, STRINGS, NUM_MIXES };
+
+struct Input {
+  GeneratedProgram program;
+  size_t tokens = 0;
+};
+
+// Program for Args {log2 of leaves, max depth, Mix}, cached because the
+// same shape is used by every phase. Entries are never moved once returned:
+// the cache is a list of nodes rather than a vector.
+const Input& input(const benchmark::State& state) {
+  static std::mutex mu;
+  static std::list<std::pair<std::vector<int64_t>, Input>> cache;
+  std::lock_guard<std::mutex> lock(mu);
+  const std::vector<int64_t> key = {state.range(0), state.range(1),
+                                    state.range(2)};
+  for (const auto& entry : cache) {
+    if (entry.first == key) return entry.second;
+  }
+  ProgramShape shape;
+  shape.leaves = size_t{1} << state.range(0);
+  shape.depth = state.range(1);
+  switch (state.range(2)) {
+    case ARITHMETIC:
+      shape.arithmetic = 10, shape.comparison = 1, shape.equality = 0;
+      shape.concat = 0;
+      break;
+    case LOGIC:
+      shape.arithmetic = 2, shape.comparison = 3, shape.equality = 4;
+      shape.concat = 1;
+      break;
+    case STRINGS:
+      shape.arithmetic = 1, shape.comparison = 0, shape.equality = 1;
+      shape.concat = 8;
+      break;
+  }
+  Input in;
+  in.program = generateProgram(shape);
+  const std::string& src = in.program.source;
+  ErrorReporter err(src);
+  Scanner s(&err, src.data(), src.data() + src.size());
+  while (s.next().type() != TokenType::END_OF_FILE) ++in.tokens;
+  cache.emplace_back(key, std::move(in));
+  return cache.back().second;
+}
+
+ast::Tree parse(const std::string& src) {
+  ErrorReporter err(src);
+  Parser parser(&err, src.data(), src.data() + src.size());
+  return parser.parse();
+}
+
+void setRates(benchmark::State& state, const Input& in) {
+  state.SetBytesProcessed(state.iterations() * in.program.source.size());
+  state.counters["tokens"] = benchmark::Counter(
+      state.iterations() * in.tokens, benchmark::Counter::kIsRate);
+  state.counters["nodes"] = benchmark::Counter(
+      state.iterations() * in.program.nodes, benchmark::Counter::kIsRate);
+}
+
+void BM_ScannerNext(benchmark::State& state) {
+  const Input& in = input(state);
+  const std::string& src = in.program.source;
+  for (auto _ : state) {
+    ErrorReporter err(src);
+    Scanner s(&err, src.data(), src.data() + src.size());
+    while (s.next().type() != TokenType::END_OF_FILE) {}
+  }
+  setRates(state, in);
+}
+
+void BM_ParserParse(benchmark::State& state) {
+  const Input& in = input(state);
+  for (auto _ : state) {
+    ast::Tree tree = parse(in.program.source);
+    if (not tree.get()) state.SkipWithError("parse failed");
+    benchmark::DoNotOptimize(tree.get());
+  }
+  setRates(state, in);
+}
+
+void BM_EvaluatorEval(benchmark::State& state) {
+  const Input& in = input(state);
+  const ast::Tree tree = parse(in.program.source);
+  for (auto _ : state) {
+    ast::Value value;
+    auto status = ast::Evaluator::eval(tree.get(), &value);
+    if (not status.ok) state.SkipWithError(status.message.c_str());
+    benchmark::DoNotOptimize(value);
+  }
+  setRates(state, in);
+}
+
+void BM_PrinterPrint(benchmark::State& state) {
+  const Input& in = input(state);
+  const ast::Tree tree = parse(in.program.source);
+  for (auto _ : state) {
+    std::string out = ast::Printer::print(tree.get());
+    benchmark::DoNotOptimize(out.data());
+  }
+  setRates(state, in);
+}
+
+// Args: {log2 of leaves, max depth, Mix}. Depth 0 gives balanced trees;
+// 40 lets them grow lopsided.
+void shapeArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"log2_leaves", "depth", "mix"});
+  for (int mix = 0; mix < NUM_MIXES; ++mix) {
+    for (int leaves : {10, 16}) {
+      for (int depth : {0, 40}) b->Args({leaves, depth, mix});
+    }
+  }
+}
+
+BENCHMARK(BM_ScannerNext)->Apply(shapeArgs);
+BENCHMARK(BM_ParserParse)->Apply(shapeArgs);
+// Parsing on several threads at once, as --batch does: all of them intern
+// identifiers and string literals into the global pool.
+BENCHMARK(BM_ParserParse)
+    ->ArgNames({"log2_leaves", "depth", "mix"})
+    ->Args({10, 0, STRINGS})
+    ->Args({16, 0, STRINGS})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+BENCHMARK(BM_EvaluatorEval)->Apply(shapeArgs);
+BENCHMARK(BM_PrinterPrint)->Apply(shapeArgs);
+
+}  // namespace
+}  // namespace lox
+
+int main(int argc, char** argv) {
+  // Later flags win, so an explicit --benchmark_format overrides this.
+  std::vector<char*> args(argv, argv + argc);
+  char json[] = "--benchmark_format=json";
+  args.insert(args.begin() + 1, json);
+  int n = args.size();
+  benchmark::Initialize(&n, args.data());
+  if (benchmark::ReportUnrecognizedArguments(n, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include <sys/time.h>
+#include <unordered_map>
+#include <vector>
+
+namespace lox {
+namespace profile {
+
+namespace {
+
+// Samples are appended to one preallocated pool of words, since the signal
+// handler can neither allocate nor lock. Each sample is its stack depth
+// followed by its stored frames, outermost first. Unused words are -1.
+constexpr size_t kPoolWords = size_t{1} << 22;
+std::unique_ptr<int32_t[]> pool;
+std::atomic<size_t> cursor{0};
+std::atomic<uint64_t> numSamples{0};
+std::atomic<uint64_t> numDropped{0};
+struct sigaction previousAction;
+
+void onProfile(int) {
+  const int savedErrno = errno;
+  const internal::Stack& s = internal::stack;
+  const int depth = s.depth;
+  std::atomic_signal_fence(std::memory_order_acquire);
+  const int n = std::min(depth, kMaxDepth);
+  const size_t at = cursor.fetch_add(n + 1, std::memory_order_relaxed);
+  if (at + n + 1 > kPoolWords) {
+    numDropped.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    std::copy(s.frames, s.frames + n, &pool[at + 1]);
+    pool[at] = depth;
+    numSamples.fetch_add(1, std::memory_order_relaxed);
+  }
+  errno = savedErrno;
+}
+
+void setTimer(long micros) {
+  itimerval timer = {};
+  timer.it_interval.tv_sec = micros / 1000000;
+  timer.it_interval.tv_usec = micros % 1000000;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+// Names frames "line:column operator", computing lines from the source.
+class FrameNames {
+ public:
+  explicit FrameNames(std::string_view src) : src_(src) {
+    lineStarts_.push_back(0);
+    for (size_t i = 0; i < src.size(); ++i) {
+      if (src[i] == '\n') lineStarts_.push_back(i + 1);
+    }
+  }
+
+  const std::string& operator()(int32_t offset) {
+    auto it = names_.find(offset);
+    if (it != names_.end()) return it->second;
+    const size_t line =
+        std::upper_bound(lineStarts_.begin(), lineStarts_.end(),
+                         static_cast<size_t>(offset)) -
+        lineStarts_.begin();
+    const size_t column = offset - lineStarts_[line - 1] + 1;
+    std::string_view op = src_.substr(std::min<size_t>(offset, src_.size()));
+    op = op.substr(0, op.size() > 1 && op[1] == '=' ? 2 : 1);
+    return names_[offset] = fmt::format("{}:{} {}", line, column, op);
+  }
+
+ private:
+  std::string_view src_;
+  std::vector<size_t> lineStarts_;
+  std::unordered_map<int32_t, std::string> names_;
+};
+
+}  // namespace
+
+bool start(int hz) {
+  if (hz <= 0 || hz > 1000000) return false;
+  if (not pool) pool.reset(new int32_t[kPoolWords]);
+  std::fill(pool.get(), pool.get() + kPoolWords, -1);
+  cursor = 0;
+  numSamples = 0;
+  numDropped = 0;
+  internal::active = true;
+  struct sigaction action = {};
+  action.sa_handler = onProfile;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, &previousAction) != 0) {
+    internal::active = false;
+    return false;
+  }
+  setTimer(1000000 / hz);
+  return true;
+}
+
+void stop() {
+  setTimer(0);
+  sigaction(SIGPROF, &previousAction, nullptr);
+  internal::active = false;
+}
+
+uint64_t samples() { return numSamples.load(std::memory_order_relaxed); }
+uint64_t dropped() { return numDropped.load(std::memory_order_relaxed); }
+
+bool write(const std::string& path, const ErrorReporter& err) {
+  FrameNames names(err.source());
+  std::map<std::string, uint64_t> stacks;
+  const size_t end = std::min(cursor.load(), kPoolWords);
+  for (size_t at = 0; pool && at < end && pool[at] >= 0;) {
+    const int depth = pool[at];
+    const int n = std::min(depth, kMaxDepth);
+    std::string stack;
+    for (int i = 0; i < n; ++i) {
+      if (i > 0) stack += ';';
+      stack += names(pool[at + 1 + i]);
+    }
+    if (depth == 0) stack = "[interpreter]";
+    if (depth > n) stack += ";...";
+    ++stacks[stack];
+    at += n + 1;
+  }
+  std::FILE* f = std::fopen(path.c_str(), "w");
+  if (not f) return false;
+  for (const auto& [stack, count] : stacks) {
+    fmt::print(f, "{} {}\n", stack, count);
+  }
+  const bool ok = not std::ferror(f);
+  return std::fclose(f) == 0 && ok;
+}
+
+}  // namespace profile
+}  // namespace lox
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "error-reporter.hpp"
+
+namespace lox {
+namespace profile {
+
+// Sampling profiler for Lox code rather than for the interpreter. While it
+// runs, the Evaluator keeps a stack of the operators it is in the middle of
+// evaluating, one source offset each, and a SIGPROF timer periodically
+// copies the stack of whichever thread it interrupts. The result is written
+// as folded stacks, one line per distinct stack:
+//   1:1 ==;1:6 *;2:3 + 42
+// where each frame is line:column and the operator at that offset, and the
+// count is the number of samples. flamegraph.pl and speedscope read it.
+//
+// Only one profile can run at a time. Evaluating without profiling costs a
+// test of a flag cached per evaluation.
+
+// Frames kept per sample; deeper stacks lose their innermost frames.
+inline constexpr int kMaxDepth = 128;
+
+namespace internal {
+
+struct Stack {
+  int32_t frames[kMaxDepth];
+  // May exceed kMaxDepth, in which case the frames past it are not stored.
+  int depth;
+};
+
+inline std::atomic<bool> active{false};
+inline thread_local Stack stack;
+
+}  // namespace internal
+
+inline bool active() {
+  return internal::active.load(std::memory_order_relaxed);
+}
+
+// Starts sampling @hz times per second of CPU time used by the process.
+// Returns false if the timer cannot be set up.
+bool start(int hz);
+// Stops sampling.
+void stop();
+// Number of samples taken, and of samples that did not fit in the buffer.
+uint64_t samples();
+uint64_t dropped();
+// Writes the samples as folded stacks to @path, mapping offsets to lines
+// and columns of the source of @err. Returns false on I/O errors.
+bool write(const std::string& path, const ErrorReporter& err);
+
+// Marks the operator at source offset @offset as being evaluated by the
+// calling thread, until the matching pop().
+inline void push(int32_t offset) {
+  internal::Stack& s = internal::stack;
+  if (s.depth < kMaxDepth) s.frames[s.depth] = offset;
+  // The frame must be in place before the signal handler can see it.
+  std::atomic_signal_fence(std::memory_order_release);
+  ++s.depth;
+}
+inline void pop() { --internal::stack.depth; }
+
+}  // namespace profile
+}  // namespace lox
@@ -0,0 +1,182 @@
+#include "program-cache.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include "hash.hpp"
+
+namespace lox {
+
+ProgramCache::ProgramCache(size_t budget, size_t buckets)
+  : budget_(budget), mask_(buckets - 1),
+    buckets_(new std::atomic<Entry*>[buckets]) {
+  for (size_t i = 0; i < buckets; ++i) buckets_[i].store(nullptr);
+}
+
+ProgramCache::~ProgramCache() {
+  for (Entry* entry : clock_) delete entry;
+  for (Entry* entry : retired_) delete entry;
+}
+
+std::shared_ptr<const Program> ProgramCache::find(std::string_view source) {
+  std::shared_ptr<const Program> found;
+  if (budget_ == 0) return found;
+  const uint64_t hash = hashBytes(source);
+  ReaderSlot* slot = enter();
+  for (Entry* e = buckets_[hash & mask_].load(); e != nullptr;
+       e = e->next.load()) {
+    if (e->hash == hash && e->program->source == source) {
+      // Avoid dirtying the cache line when the mark is already set.
+      if (not e->referenced.load(std::memory_order_relaxed)) {
+        e->referenced.store(true, std::memory_order_relaxed);
+      }
+      found = e->program;
+      break;
+    }
+  }
+  std::atomic<uint64_t>& count = found ? slot->hits : slot->misses;
+  count.store(count.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+  slot->epoch.store(0, std::memory_order_release);
+  return found;
+}
+
+// Takes the calling thread's reader slot, or the next free one if another
+// thread holds it, and tags it with the current epoch.
+ProgramCache::ReaderSlot* ProgramCache::enter() {
+  static std::atomic<size_t> threads{0};
+  thread_local const size_t thread =
+      threads.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = thread;; ++i) {
+    ReaderSlot& slot = readers_[i % kReaderSlots];
+    uint64_t idle = 0;
+    // Sequentially consistent, like the writer's scan in reclaim(): either
+    // the writer sees this lookup's epoch, or the lookup no longer sees the
+    // entries unlinked before the epoch it read.
+    if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+        slot.epoch.compare_exchange_strong(idle, epoch_.load())) {
+      return &slot;
+    }
+  }
+}
+
+void ProgramCache::insert(std::shared_ptr<const Program> program) {
+  const size_t bytes = sizeof(Entry) + program->bytes();
+  if (bytes > budget_) return;
+  const uint64_t hash = hashBytes(program->source);
+  std::atomic<Entry*>& bucket = buckets_[hash & mask_];
+
+  std::lock_guard<std::mutex> lock(mu_);
+  for (Entry* e = bucket.load(); e != nullptr; e = e->next.load()) {
+    if (e->hash == hash && e->program->source == program->source) return;
+  }
+  reclaim();
+  while (bytes_ + retiredBytes_ + bytes > budget_ && size_ > 0) {
+    evict();
+    reclaim();
+  }
+  // Lookups in flight still hold on to what was evicted.
+  if (bytes_ + retiredBytes_ + bytes > budget_) return;
+
+  auto* entry = new Entry;
+  entry->hash = hash;
+  entry->program = std::move(program);
+  entry->bytes = bytes;
+  if (freeSlots_.empty()) {
+    entry->slot = clock_.size();
+    clock_.push_back(entry);
+  } else {
+    entry->slot = freeSlots_.back();
+    freeSlots_.pop_back();
+    clock_[entry->slot] = entry;
+  }
+  entry->next.store(bucket.load());
+  bucket.store(entry);  // publishes the fully built entry.
+  bytes_ += bytes;
+  ++size_;
+}
+
+size_t ProgramCache::bytes() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return bytes_;
+}
+
+size_t ProgramCache::retiredBytes() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return retiredBytes_;
+}
+
+size_t ProgramCache::size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return size_;
+}
+
+uint64_t ProgramCache::hits() const {
+  uint64_t hits = 0;
+  for (const ReaderSlot& slot : readers_) {
+    hits += slot.hits.load(std::memory_order_relaxed);
+  }
+  return hits;
+}
+
+uint64_t ProgramCache::misses() const {
+  uint64_t misses = 0;
+  for (const ReaderSlot& slot : readers_) {
+    misses += slot.misses.load(std::memory_order_relaxed);
+  }
+  return misses;
+}
+
+// Only called with entries in the cache, so the hand finds a victim within
+// two sweeps at most.
+void ProgramCache::evict() {
+  while (true) {
+    if (hand_ >= clock_.size()) hand_ = 0;
+    Entry* entry = clock_[hand_++];
+    if (entry == nullptr) continue;
+    if (entry->referenced.load(std::memory_order_relaxed)) {
+      entry->referenced.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    unlink(entry);
+    clock_[entry->slot] = nullptr;
+    freeSlots_.push_back(entry->slot);
+    bytes_ -= entry->bytes;
+    --size_;
+    entry->retiredEpoch = epoch_.fetch_add(1);
+    retiredBytes_ += entry->bytes;
+    retired_.push_back(entry);
+    return;
+  }
+}
+
+void ProgramCache::unlink(Entry* entry) {
+  std::atomic<Entry*>* link = &buckets_[entry->hash & mask_];
+  while (link->load() != entry) link = &link->load()->next;
+  // Lookups standing on @entry can still follow its next pointer, which is
+  // left intact.
+  link->store(entry->next.load());
+}
+
+// Frees the retired entries that no lookup in flight can be reading: those
+// retired before the epoch of the oldest lookup.
+void ProgramCache::reclaim() {
+  if (retired_.empty()) return;
+  uint64_t oldest = std::numeric_limits<uint64_t>::max();
+  for (const ReaderSlot& slot : readers_) {
+    const uint64_t epoch = slot.epoch.load();
+    if (epoch != 0) oldest = std::min(oldest, epoch);
+  }
+  size_t kept = 0;
+  for (Entry* entry : retired_) {
+    if (entry->retiredEpoch < oldest) {
+      retiredBytes_ -= entry->bytes;
+      delete entry;
+    } else {
+      retired_[kept++] = entry;
+    }
+  }
+  retired_.resize(kept);
+}
+
+}  // namespace lox
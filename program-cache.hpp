@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ast.hpp"
+
+namespace lox {
+
+// A parsed program together with the source text it was parsed from. The
+// tree's tokens point into @source, so the two are kept together.
+struct Program {
+  std::string source;
+  ast::Tree tree;
+
+  // Approximate memory held by the program.
+  size_t bytes() const {
+    return sizeof(Program) + source.capacity() +
+           (tree.arena() ? tree.arena()->bytesReserved() : 0) +
+           tree.stringBytes();
+  }
+};
+
+// Cache of parsed programs keyed by their source text, shared by any number
+// of threads. Programs are immutable once cached and handed out as shared
+// pointers, so an evicted program stays alive for as long as it is in use.
+//
+// Lookups take no lock: entries hang off a fixed array of buckets and are
+// only ever linked and unlinked with atomic stores. Nor do they write to
+// memory shared with other threads. Each thread announces its lookups in a
+// reader slot of its own, tagged with the epoch it started in, and keeps its
+// hit and miss counts there. A writer tags every entry it unlinks with the
+// epoch it was unlinked in, and only frees it once no lookup from that
+// epoch or earlier is in flight. Inserts and evictions serialize on a
+// mutex.
+//
+// The total size of the cached programs, together with the evicted entries
+// that are not freed yet, is kept within a byte budget.
+// Eviction follows the CLOCK policy: a lookup marks the entry it finds as
+// referenced, and the clock hand evicts the first unreferenced entry it
+// reaches, clearing marks as it passes them.
+class ProgramCache {
+ public:
+  static constexpr size_t kDefaultBuckets = 1 << 12;
+
+  // A @budget of 0 disables caching. @buckets must be a power of two.
+  explicit ProgramCache(size_t budget, size_t buckets = kDefaultBuckets);
+  ProgramCache(const ProgramCache&) = delete;
+  ProgramCache& operator=(const ProgramCache&) = delete;
+  ~ProgramCache();
+
+  // Returns the cached program whose source is @source, or null.
+  std::shared_ptr<const Program> find(std::string_view source);
+  // Caches @program unless a program with the same source is already
+  // cached or it alone exceeds the budget. Evicts other programs as needed
+  // to stay within the budget.
+  void insert(std::shared_ptr<const Program> program);
+
+  size_t budget() const { return budget_; }
+  // Bytes held by the cached programs.
+  size_t bytes() const;
+  // Bytes held by evicted entries that lookups in flight may still read.
+  // Programs handed out by find() live on regardless.
+  size_t retiredBytes() const;
+  size_t size() const;
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+ private:
+  // Concurrent lookups beyond this many share slots.
+  static constexpr size_t kReaderSlots = 64;
+
+  struct Entry {
+    uint64_t hash;
+    std::shared_ptr<const Program> program;
+    size_t bytes;
+    size_t slot;  // index in clock_.
+    uint64_t retiredEpoch = 0;
+    std::atomic<Entry*> next{nullptr};
+    std::atomic<bool> referenced{false};
+  };
+
+  // Owned by one lookup at a time, which sets @epoch for its duration.
+  struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{0};  // 0 while no lookup holds the slot.
+    // Only written by the lookup holding the slot.
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+  };
+
+  ReaderSlot* enter();
+  void evict();
+  void unlink(Entry* entry);
+  void reclaim();
+
+  const size_t budget_;
+  const size_t mask_;
+  std::unique_ptr<std::atomic<Entry*>[]> buckets_;
+
+  ReaderSlot readers_[kReaderSlots];
+  // Starts at 1, so that a slot's epoch is never 0 while it is held.
+  alignas(64) std::atomic<uint64_t> epoch_{1};
+
+  // Guards everything below as well as linking and unlinking entries.
+  alignas(64) mutable std::mutex mu_;
+  std::vector<Entry*> clock_;      // null where an entry was evicted.
+  std::vector<size_t> freeSlots_;  // null indices of clock_.
+  size_t hand_ = 0;
+  size_t bytes_ = 0;
+  size_t size_ = 0;
+  std::vector<Entry*> retired_;  // unlinked, but possibly still being read.
+  size_t retiredBytes_ = 0;
+};
+
+}  // namespace lox
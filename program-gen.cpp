@@ -0,0 +1,131 @@
+#include "program-gen.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+
+namespace lox {
+
+namespace {
+
+enum class Type { NUMBER, BOOL, STRING };
+
+class Generator {
+ public:
+  explicit Generator(const ProgramShape& shape)
+    : shape_(shape), rng_(shape.seed) {}
+
+  GeneratedProgram run() {
+    int depth = std::max(shape_.depth, 0);
+    while (depth < 62 && (size_t{1} << depth) < shape_.leaves) ++depth;
+    generate(resultType(), std::max<size_t>(shape_.leaves, 1), depth);
+    return std::move(program_);
+  }
+
+ private:
+  enum Op { ARITHMETIC, COMPARISON, EQUALITY, CONCAT };
+
+  // Draws a number in [0, @n). Distributions are implemented differently
+  // by each standard library, so numbers are derived from the engine's
+  // output, which the standard fixes, to give the same program everywhere.
+  // The slight bias of the modulo does not matter for benchmark inputs.
+  uint64_t draw(uint64_t n) {
+    // Two statements, as the order operands are evaluated in is not fixed.
+    const uint64_t high = rng_();
+    return (high << 32 | rng_()) % n;
+  }
+  int pick(int n) { return static_cast<int>(draw(n)); }
+
+  // Type of an operator drawn from the configured mix.
+  Type resultType() {
+    const int weights[] = {shape_.arithmetic, shape_.comparison,
+                           shape_.equality, shape_.concat};
+    int total = 0;
+    for (int w : weights) total += std::max(w, 0);
+    if (total == 0) return Type::NUMBER;
+    int p = pick(total);
+    for (int op = ARITHMETIC; op <= CONCAT; ++op) {
+      p -= std::max(weights[op], 0);
+      if (p < 0) return resultOf(static_cast<Op>(op));
+    }
+    return Type::NUMBER;
+  }
+  static Type resultOf(Op op) {
+    switch (op) {
+      case ARITHMETIC: return Type::NUMBER;
+      case COMPARISON:
+      case EQUALITY: return Type::BOOL;
+      case CONCAT: return Type::STRING;
+    }
+    return Type::NUMBER;
+  }
+
+  // Appends an expression of @type with @leaves literals and at most
+  // @depth levels of binary operators.
+  void generate(Type type, size_t leaves, int depth) {
+    ++program_.nodes;
+    if (leaves == 1) return leaf(type);
+    Op op = type == Type::NUMBER ? ARITHMETIC
+            : type == Type::STRING ? CONCAT
+                                   : COMPARISON;
+    const int comparison = std::max(shape_.comparison, 0);
+    const int equality = std::max(shape_.equality, 0);
+    if (type == Type::BOOL && comparison + equality > 0 &&
+        pick(comparison + equality) >= comparison) {
+      op = EQUALITY;
+    }
+    Type operands = Type::NUMBER;
+    if (op == EQUALITY) operands = resultType();
+    if (op == CONCAT) operands = Type::STRING;
+    // Both sides must fit in depth - 1 levels.
+    const size_t half = size_t{1} << (depth - 1);
+    const size_t lo = leaves > half ? leaves - half : 1;
+    const size_t hi = std::min(leaves - 1, half);
+    const size_t left = lo + draw(hi - lo + 1);
+    static const char* const kOps[][4] = {{" + ", " - ", " * ", " / "},
+                                          {" < ", " <= ", " > ", " >= "},
+                                          {" == ", " != "},
+                                          {" + "}};
+    static const int kNumOps[] = {4, 4, 2, 1};
+    program_.source += '(';
+    generate(operands, left, depth - 1);
+    program_.source += kOps[op][pick(kNumOps[op])];
+    generate(operands, leaves - left, depth - 1);
+    program_.source += ')';
+  }
+  void leaf(Type type) {
+    // There is no prefix operator on strings.
+    if (type != Type::STRING && pick(100) < shape_.unary) {
+      program_.source += type == Type::BOOL ? '!' : '-';
+      ++program_.nodes;
+    }
+    switch (type) {
+      case Type::NUMBER:
+        program_.source += std::to_string(pick(1000));
+        if (pick(4) == 0) program_.source += ".5";
+        break;
+      case Type::BOOL:
+        program_.source += pick(2) ? "true" : "false";
+        break;
+      case Type::STRING:
+        program_.source += '"';
+        for (int i = 1 + pick(8); i > 0; --i) {
+          program_.source += static_cast<char>('a' + pick(26));
+        }
+        program_.source += '"';
+        break;
+    }
+  }
+
+  const ProgramShape& shape_;
+  std::mt19937 rng_;
+  GeneratedProgram program_;
+};
+
+}  // namespace
+
+GeneratedProgram generateProgram(const ProgramShape& shape) {
+  return Generator(shape).run();
+}
+
+}  // namespace lox
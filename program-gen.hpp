@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lox {
+
+// Shape of a synthetic program. Every program is a single expression that
+// evaluates without errors, so benchmarks can run the whole pipeline on it.
+struct ProgramShape {
+  // Number of literal operands.
+  size_t leaves = 1024;
+  // Maximum nesting of binary operators; raised to fit @leaves if needed.
+  int depth = 16;
+  // Relative weights of the binary operators at inner nodes: arithmetic
+  // ('+', '-', '*', '/' on numbers), comparisons ('<', '<=', '>', '>='),
+  // equality ('==', '!=' on operands of any one type) and string
+  // concatenation.
+  int arithmetic = 6;
+  int comparison = 2;
+  int equality = 1;
+  int concat = 1;
+  // Percentage of literals with a prefix operator ('-' or '!').
+  int unary = 10;
+  uint32_t seed = 42;
+};
+
+struct GeneratedProgram {
+  std::string source;
+  // Number of nodes in the program's syntax tree.
+  size_t nodes = 0;
+};
+
+// Generates a random program of @shape. The same shape always gives the
+// same program, whatever the compiler and standard library.
+GeneratedProgram generateProgram(const ProgramShape& shape);
+
+}  // namespace lox
@@ -0,0 +1,139 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <random>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "error-reporter.hpp"
+#include "scanner.hpp"
+#include "simd-scan.hpp"
+
+namespace lox {
+namespace {
+
+constexpr size_t kInputSize = 8 << 20;
+
+// Lox-like source of roughly kInputSize bytes. @shape picks the mix:
+// 0 - ordinary code: short identifiers, numbers, operators, some comments.
+// 1 - long comments and indentation.
+// 2 - long string literals, a few with escapes.
+// 3 - punctuation: dense one- and two-character operators.
+std::string makeSource(int shape) {
+  std::mt19937 rng(42);
+  auto pick = [&rng](int n) { return static_cast<int>(rng() % n); };
+  const char* idents[] = {"i", "count", "total_value", "x1", "print",
+                          "while", "customerAccountBalance", "nil"};
+  std::string src;
+  src.reserve(kInputSize + 256);
+  while (src.size() < kInputSize) {
+    switch (shape) {
+      case 0:
+        src += std::string(2 * pick(4), ' ');
+        src += idents[pick(8)];
+        src += " = ";
+        src += std::to_string(pick(100000));
+        src += pick(2) ? " + " : " <= ";
+        src += idents[pick(8)];
+        src += pick(8) == 0 ? "; // note\n" : ";\n";
+        break;
+      case 1:
+        src += std::string(4 * pick(6), ' ');
+        src += "// " + std::string(40 + pick(80), 'c') + "\n";
+        src += std::string(4 * pick(6), ' ');
+        src += "x = 1;\n";
+        break;
+      case 2:
+        src += "s = \"" + std::string(30 + pick(200), 's');
+        src += pick(4) == 0 ? "\\\"quoted\\\"\";\n" : "\";\n";
+        break;
+      case 3: {
+        const char* ops[] = {"(", ")", "{", "}", ",", ".", "-", "+", ";",
+                             "*", "!", "!=", "=", "==", ">", ">=", "<",
+                             "<=", "/"};
+        for (int i = 0; i < 16; ++i) src += ops[pick(19)];
+        src += pick(2) ? " a1\n" : " 7\n";
+        break;
+      }
+    }
+  }
+  return src;
+}
+
+// Counts branch misses of the calling thread in user space, if the kernel
+// exposes hardware counters (it often does not in VMs and containers).
+class BranchMisses {
+ public:
+  BranchMisses() {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd_ >= 0) ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+  ~BranchMisses() {
+#ifdef __linux__
+    if (fd_ >= 0) close(fd_);
+#endif
+  }
+  bool available() const { return fd_ >= 0; }
+  long long read() const {
+    long long count = 0;
+#ifdef __linux__
+    if (fd_ < 0 || ::read(fd_, &count, sizeof(count)) != sizeof(count)) {
+      return 0;
+    }
+#endif
+    return count;
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+void BM_Scan(benchmark::State& state) {
+  const std::string src = makeSource(state.range(0));
+  simd::setLevel(static_cast<simd::Level>(state.range(1)));
+  size_t tokens = 0;
+  BranchMisses misses;
+  const long long missesBefore = misses.read();
+  for (auto _ : state) {
+    ErrorReporter err(src);
+    Scanner s(&err, src.data(), src.data() + src.size());
+    while (s.next().type() != TokenType::END_OF_FILE) ++tokens;
+  }
+  simd::setLevel(simd::detectLevel());
+  state.SetBytesProcessed(state.iterations() * src.size());
+  state.counters["tokens"] = benchmark::Counter(
+      tokens, benchmark::Counter::kIsRate);
+  if (misses.available()) {
+    state.counters["branch_misses/token"] =
+        static_cast<double>(misses.read() - missesBefore) / tokens;
+  }
+}
+
+// Args: {shape, simd::Level}.
+void scanArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"shape", "level"});
+  for (int shape = 0; shape < 4; ++shape) {
+    for (int level = 0; level < 3; ++level) b->Args({shape, level});
+  }
+}
+BENCHMARK(BM_Scan)->Apply(scanArgs)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace lox
+
+BENCHMARK_MAIN();
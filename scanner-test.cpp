@@ -1,7 +1,13 @@
 #include "error-reporter.hpp"
+#include "intern.hpp"
 #include "scanner.hpp"
+#include "simd-scan.hpp"
+#include "stream-input.hpp"
+#include "token-stream.hpp"
 #include "token.hpp"
+#include <deque>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 namespace lox {
 
@@ -10,7 +16,7 @@ namespace lox {
 class ScanHarness {
  public:
   ScanHarness(const std::string& src)
-    : src_(src), err_(src), s_(&err_, src_.begin(), src_.end()) {}
+    : src_(src), err_(src_), s_(&err_, src_.begin(), src_.end()) {}
   std::vector<Token> scanAll() {
     std::vector<Token> tokens;
     while (true) {
@@ -254,6 +260,19 @@ TEST(Scanner, Keywords) {
   }
 }
 
+TEST(Scanner, KeywordLookalikes) {
+  // Identifiers that share a length, first or last character with a keyword
+  // must not be classified as one.
+  ScanHarness s("an andy nill fore of whale thus vat _if retur classy e");
+  auto tokens = s.scanAll();
+  EXPECT_FALSE(s.hasErrors());
+  ASSERT_EQ(13, tokens.size());
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_EQ(TokenType::IDENTIFIER, tokens[i].type()) << tokens[i].lexeme();
+  }
+  EXPECT_EQ(TokenType::END_OF_FILE, tokens[12].type());
+}
+
 TEST(Scanner, Numbers) {
   {
     ScanHarness s("123");
@@ -502,33 +521,172 @@ TEST(Scanner, MultiLineProgram) {
   EXPECT_EQ(TokenType::END_OF_FILE, tokens[26].type());
 }
 
-TEST(Scanner, Rewind) {
-  {
-    const std::string src("hello { while != true");
-    ErrorReporter err(src);
-    Scanner s(&err, src.begin(), src.end());
-    auto tokenOne = s.next();
-    EXPECT_EQ(TokenType::IDENTIFIER, tokenOne.type());
-    EXPECT_EQ("hello", tokenOne.lexeme());
-    auto tokenTwo = s.next();
-    EXPECT_EQ(TokenType::LEFT_BRACE, tokenTwo.type());
-    EXPECT_EQ("{", tokenTwo.lexeme());
-    s.rewind();
-    auto tokenThree = s.next();
-    EXPECT_EQ(TokenType::LEFT_BRACE, tokenThree.type());
-    EXPECT_EQ("{", tokenThree.lexeme());
-    auto tokenFour = s.next();
-    EXPECT_EQ(TokenType::WHILE, tokenFour.type());
-    EXPECT_EQ("while", tokenFour.lexeme());
-    auto tokenFive = s.next();
-    EXPECT_EQ(TokenType::BANG_EQUAL, tokenFive.type());
-    EXPECT_EQ("!=", tokenFive.lexeme());
-    auto tokenSix = s.next();
-    EXPECT_EQ(TokenType::TRUE, tokenSix.type());
-    EXPECT_EQ("true", tokenSix.lexeme());
-    auto tokenSeven = s.next();
-    EXPECT_EQ(TokenType::END_OF_FILE, tokenSeven.type());
+TEST(Scanner, LexemesViewSource) {
+  const std::string src("foo \"bar\" \"b\\\"z\" 12.5 !=");
+  ErrorReporter err(src);
+  Scanner s(&err, src.begin(), src.end());
+  auto foo = s.next();
+  EXPECT_EQ("foo", foo.lexeme());
+  EXPECT_EQ(src.data(), foo.lexeme().data());
+  auto bar = s.next();
+  EXPECT_EQ("bar", bar.lexeme());
+  EXPECT_EQ(src.data() + 5, bar.lexeme().data());
+  auto escaped = s.next();  // escapes force an unescaped copy.
+  EXPECT_EQ("b\"z", escaped.lexeme());
+  EXPECT_EQ(10, escaped.location());
+  auto number = s.next();
+  EXPECT_EQ("12.5", number.lexeme());
+  EXPECT_EQ(src.data() + 17, number.lexeme().data());
+  auto bangEqual = s.next();
+  EXPECT_EQ("!=", bangEqual.lexeme());
+  EXPECT_EQ(TokenType::END_OF_FILE, s.next().type());
+  EXPECT_FALSE(err.hasErrors());
+}
+
+TEST(Scanner, NonContiguousSource) {
+  const std::string text("foo \"b\\\"z\" 12.5");
+  const std::deque<char> src(text.begin(), text.end());
+  ErrorReporter err(text);
+  Scanner s(&err, src.begin(), src.end());
+  auto foo = s.next();
+  EXPECT_EQ(TokenType::IDENTIFIER, foo.type());
+  EXPECT_EQ("foo", foo.lexeme());
+  auto str = s.next();
+  EXPECT_EQ(TokenType::STRING, str.type());
+  EXPECT_EQ("b\"z", str.lexeme());
+  auto number = s.next();
+  EXPECT_EQ(TokenType::NUMBER, number.type());
+  EXPECT_EQ("12.5", number.lexeme());
+  EXPECT_EQ(TokenType::END_OF_FILE, s.next().type());
+  EXPECT_FALSE(err.hasErrors());
+}
+
+TEST(Scanner, SimdLevelsAgree) {
+  // Runs longer than a SIMD block and runs ending at every offset inside
+  // one, scanned with each kernel level against the character-at-a-time
+  // path used for non-contiguous sources.
+  std::string text;
+  for (int n = 1; n < 70; ++n) {
+    text += std::string(n, 'a') + "_9" + std::string(n % 7, ' ') + "\n";
+    text += std::string(n, '7') + "." + std::string(n % 5 + 1, '3') + "\t";
+    text += "\"" + std::string(n, 's') + "\\\"" + std::string(n, 'q') +
+            "\" != ";
+    text += "// " + std::string(n, 'c') + "\"\\\n";
+  }
+  text += "@ \xe9 \"unterminated " + std::string(40, 'u');
+  const std::deque<char> chars(text.begin(), text.end());
+
+  // Lexemes are copied, as those of numbers only last until the next token.
+  std::vector<Token> expected;
+  std::vector<std::string> lexemes;
+  ErrorReporter expectedErr(text);
+  Scanner generic(&expectedErr, chars.begin(), chars.end());
+  do {
+    expected.push_back(generic.next());
+    lexemes.emplace_back(expected.back().lexeme());
+  } while (expected.back().type() != TokenType::END_OF_FILE);
+
+  for (auto level :
+       {simd::Level::GENERIC, simd::Level::SSE2, simd::Level::AVX2}) {
+    simd::setLevel(level);
+    ErrorReporter err(text);
+    Scanner s(&err, text.data(), text.data() + text.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      auto got = s.next();
+      ASSERT_EQ(expected[i].type(), got.type()) << got.location();
+      ASSERT_EQ(expected[i].location(), got.location());
+      ASSERT_EQ(lexemes[i], got.lexeme());
+    }
+    EXPECT_EQ(expectedErr.numErrors(), err.numErrors());
   }
+  simd::setLevel(simd::detectLevel());
+}
+
+TEST(TokenStream, PeekAndAdvance) {
+  const std::string src("a + (b * 2) >= c");
+  ErrorReporter err(src);
+  TokenStream tokens(&err, src.begin(), src.end());
+  // Look further ahead than the initial capacity, forcing the ring buffer
+  // to grow while holding tokens.
+  EXPECT_EQ(TokenType::IDENTIFIER, tokens.peek().type());
+  EXPECT_EQ(TokenType::END_OF_FILE, tokens.peek(10).type());
+  EXPECT_EQ(TokenType::GREATER_EQUAL, tokens.peek(7).type());
+  EXPECT_EQ(TokenType::PLUS, tokens.peek(1).type());
+  const TokenType expected[] = {
+      TokenType::IDENTIFIER, TokenType::PLUS,          TokenType::LEFT_PAREN,
+      TokenType::IDENTIFIER, TokenType::STAR,          TokenType::NUMBER,
+      TokenType::RIGHT_PAREN, TokenType::GREATER_EQUAL, TokenType::IDENTIFIER,
+      TokenType::END_OF_FILE, TokenType::END_OF_FILE};
+  for (auto type : expected) {
+    EXPECT_EQ(type, tokens.peek().type());
+    EXPECT_EQ(type, tokens.advance().type());
+  }
+  EXPECT_FALSE(err.hasErrors());
+  // Every byte was consumed once, however far ahead we peeked.
+  EXPECT_EQ(src.size(), tokens.scanner().bytesScanned());
+}
+
+TEST(Scanner, StreamInput) {
+  // Tokens straddle the boundaries of the tiny chunks the stream reads.
+  const std::string src(
+      "hello { while != true // comment\n"
+      "\"a \\\"quoted\\\" string\" 123.456 >= identifier_with_digits_42");
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(static_cast<ssize_t>(src.size()),
+            write(fds[1], src.data(), src.size()));
+  close(fds[1]);
+
+  StreamInput in(fds[0], 7);
+  ErrorReporter streamErr({});
+  Scanner stream(&streamErr, in.begin(), in.end());
+  ErrorReporter err(src);
+  Scanner whole(&err, src.begin(), src.end());
+  while (true) {
+    auto want = whole.next();
+    auto got = stream.next();
+    EXPECT_EQ(want.type(), got.type());
+    EXPECT_EQ(want.lexeme(), got.lexeme());
+    EXPECT_EQ(want.location(), got.location());
+    if (want.type() == TokenType::END_OF_FILE) break;
+  }
+  EXPECT_FALSE(streamErr.hasErrors());
+  EXPECT_FALSE(in.failed());
+  EXPECT_EQ(src.size(), in.bytesRead());
+  EXPECT_EQ(src.size(), stream.bytesScanned());
+  close(fds[0]);
+}
+
+TEST(TokenStream, StreamedNumbers) {
+  std::string src = "\"s\"";
+  for (int i = 0; i < 500; ++i) src += " + " + std::to_string(i) + ".5";
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(static_cast<ssize_t>(src.size()),
+            write(fds[1], src.data(), src.size()));
+  close(fds[1]);
+
+  const size_t interned = InternPool::global().size();
+  StreamInput in(fds[0], 7);
+  ErrorReporter streamErr({});
+  TokenStream stream(&streamErr, in.begin(), in.end());
+  ErrorReporter err(src);
+  Scanner whole(&err, src.begin(), src.end());
+  // Hold every token at once, so that the numbers outlive the scanner's
+  // scratch space and move as the buffer grows.
+  EXPECT_EQ(TokenType::END_OF_FILE, stream.peek(1001).type());
+  while (true) {
+    const auto want = whole.next();
+    const auto got = stream.advance();
+    EXPECT_EQ(want.type(), got.type());
+    EXPECT_EQ(want.lexeme(), got.lexeme());
+    EXPECT_EQ(want.location(), got.location());
+    if (want.type() == TokenType::END_OF_FILE) break;
+  }
+  EXPECT_FALSE(streamErr.hasErrors());
+  // Only the string literal was interned, not the numbers.
+  EXPECT_EQ(interned + 1, InternPool::global().size());
+  close(fds[0]);
 }
 
 }  // namespace lox
@@ -1,12 +1,102 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <fmt/format.h>
+#include <iterator>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include "error-reporter.hpp"
+#include "intern.hpp"
+#include "simd-scan.hpp"
 #include "token.hpp"
+#include "token-type.hpp"
 
 namespace lox {
 
+namespace internal {
+
+// Iterators whose elements are laid out contiguously in memory. Tokens
+// scanned from such ranges point straight into the source buffer.
+template <typename Iterator>
+constexpr bool isContiguous =
+    std::is_pointer_v<Iterator> ||
+    std::is_same_v<Iterator, std::string::const_iterator> ||
+    std::is_same_v<Iterator, std::string::iterator> ||
+    std::is_same_v<Iterator, std::vector<char>::const_iterator> ||
+    std::is_same_v<Iterator, std::vector<char>::iterator>;
+
+// Lexical class of a source character: which rule of the grammar a token
+// starting with it follows.
+enum class CharClass : uint8_t {
+  INVALID,
+  WHITESPACE,
+  IDENTIFIER,  // [A-Za-z_]
+  DIGIT,
+  QUOTE,
+  SLASH,     // '/' or the start of a comment.
+  OPERATOR,  // any other punctuation.
+};
+
+// For a punctuation character, the token it forms on its own and, if it
+// also starts a two-character operator, that operator's second character
+// and token.
+struct OperatorTransition {
+  TokenType single = TokenType::END_OF_FILE;
+  char second = 0;
+  TokenType pair = TokenType::END_OF_FILE;
+};
+
+struct LexerTables {
+  std::array<CharClass, 256> classes{};
+  std::array<bool, 256> identifierChar{};
+  std::array<OperatorTransition, 256> operators{};
+};
+
+// Derives the tables from the operator spellings in token-type.hpp, so the
+// lexer follows the TokenType enum by construction.
+constexpr LexerTables makeLexerTables() {
+  LexerTables t;
+  for (int i = 0; i < static_cast<int>(TokenType::END_OF_FILE); ++i) {
+    const auto type = static_cast<TokenType>(i);
+    const std::string_view lexeme = operatorLexeme(type);
+    const auto first = static_cast<unsigned char>(lexeme[0]);
+    t.classes[first] = CharClass::OPERATOR;
+    if (lexeme.size() == 1) {
+      t.operators[first].single = type;
+    } else {
+      t.operators[first].second = lexeme[1];
+      t.operators[first].pair = type;
+    }
+  }
+  t.classes['/'] = CharClass::SLASH;
+  t.classes['"'] = CharClass::QUOTE;
+  t.classes[' '] = t.classes['\t'] = t.classes['\n'] = CharClass::WHITESPACE;
+  t.classes['_'] = CharClass::IDENTIFIER;
+  for (int c = 'a'; c <= 'z'; ++c) t.classes[c] = CharClass::IDENTIFIER;
+  for (int c = 'A'; c <= 'Z'; ++c) t.classes[c] = CharClass::IDENTIFIER;
+  for (int c = '0'; c <= '9'; ++c) t.classes[c] = CharClass::DIGIT;
+  for (int c = 0; c < 256; ++c) {
+    t.identifierChar[c] = t.classes[c] == CharClass::IDENTIFIER ||
+                          t.classes[c] == CharClass::DIGIT;
+  }
+  return t;
+}
+
+inline constexpr LexerTables kLexerTables = makeLexerTables();
+
+inline CharClass charClass(char c) {
+  return kLexerTables.classes[static_cast<unsigned char>(c)];
+}
+inline bool isIdentifierChar(char c) {
+  return kLexerTables.identifierChar[static_cast<unsigned char>(c)];
+}
+
+}  // namespace internal
+
 // The Scanner class allows callers to lexically scan a piece of Lox code
 // and convert it into a stream of tokens. Intended usage as follows:
 //   std::vector<Token> tokens;
@@ -16,192 +106,259 @@ namespace lox {
 //     if (token.type() == TokenType::END_OF_FILE) break;
 //     tokens.push_back(token);
 //   }
+//
+// For contiguous iterators, token lexemes are views into the scanned range,
+// which must therefore outlive the tokens. Otherwise lexemes are interned,
+// except those of numbers: every number in a long stream would otherwise
+// stay in the pool for good, so they are left in the scanner's scratch
+// space, valid only until the next call to next() (see kTransientNumbers).
+//
+// The scanner makes a single pass over its input and reads each character
+// through the iterator at most once after advancing to it, so any input
+// iterator will do, including ones over pipes and other unbuffered streams
+// (see StreamInput).
 template <typename Iterator> class Scanner {
  public:
+  // Whether the lexemes of NUMBER tokens are only valid until the next call
+  // to next(), rather than for as long as the source.
+  static constexpr bool kTransientNumbers =
+      not internal::isContiguous<Iterator>;
+
   Scanner(ErrorReporter* err, Iterator begin, Iterator end)
-    : err_(err), b_(begin), e_(end), i_(begin), prev_(begin) {}
+    : err_(err), b_(begin), e_(end), i_(begin) {
+    if constexpr (kContiguous) {
+      if (begin != end) base_ = &*begin;
+      simd_ = &simd::active();
+    }
+  }
   // Returns the next token from the program. The last token will always be
   // of type TokenType::END_OF_FILE. Repeated calls to next() after it has
   // once returned EOF will repeatedly return EOF.
-  Token next();
-  // Allows the scanner to rewind back one token in the stream. This method
-  // cannot be called twice. That is, we only support rewinding back one step.
-  void rewind() { i_ = prev_; }
+  Token next() {
+    const int start = offset();
+    const Token token = scan();
+    bytesScanned_ += offset() - start;
+    ++tokensScanned_;
+    return token;
+  }
   bool done() const { return i_ == e_; }
-  int currLocation() const { return i_ - b_; }
+  int currLocation() const { return offset(); }
+  // Number of tokens returned by next() and source bytes consumed while
+  // producing them.
+  size_t tokensScanned() const { return tokensScanned_; }
+  size_t bytesScanned() const { return bytesScanned_; }
 
  private:
+  static constexpr bool kContiguous = internal::isContiguous<Iterator>;
+
+  Token scan();
   Token scanIdentifier();
   Token scanNumber();
   Token scanString();
+  Token scanOperator();
+  // Offset of the current position from the start of the input.
+  int offset() const {
+    if constexpr (kContiguous) {
+      return i_ - b_;
+    } else {
+      return offset_;
+    }
+  }
+  // Moves to the next input character.
+  void advance() {
+    ++i_;
+    if constexpr (not kContiguous) ++offset_;
+  }
+  Token makeToken(TokenType type, int location) {
+    return Token(type, operatorLexeme(type), location);
+  }
+  // Builds a token for a lexeme assembled in lexeme_ or viewed in the
+  // source. Scratch lexemes are interned so that they outlive the scanner.
+  Token makeToken(TokenType type, std::string_view lexeme, bool scratch,
+                  int location) {
+    if (lexeme.size() > Token::kMaxLexemeLength) {
+      err_->report(location, "Token too long");
+      lexeme = lexeme.substr(0, Token::kMaxLexemeLength);
+    }
+    if (scratch) lexeme = intern(lexeme).str();
+    return Token(type, lexeme, location);
+  }
+  // Advances i_ past the run of characters satisfying @inRun at the current
+  // position. Most runs in real code are short, so the first few characters
+  // are checked inline and the SIMD @kernel only takes over for runs that
+  // continue past them. Only valid for contiguous sources.
+  template <typename InRun>
+  void skip(const char* (*kernel)(const char*, const char*), InRun inRun) {
+    constexpr int kInlineRun = 16;
+    const char* p = base_ + (i_ - b_);
+    const char* end = base_ + (e_ - b_);
+    const char* stop = end - p > kInlineRun ? p + kInlineRun : end;
+    const char* q = p;
+    while (q != stop && inRun(*q)) ++q;
+    if (q == stop && q != end) q = kernel(q, end);
+    i_ += q - p;
+  }
+  // View of the source between offset @begin and the current position.
+  std::string_view source(int begin) const {
+    return std::string_view(base_ + begin, offset() - begin);
+  }
 
   ErrorReporter* err_;
   Iterator b_;
   Iterator e_;
   Iterator i_;
-  Iterator prev_;
+  int offset_ = 0;  // offset of i_, if the input is not contiguous.
+  const char* base_ = nullptr;  // start of the source, if contiguous.
+  // Bulk scanning kernels for contiguous sources.
+  const simd::Kernels* simd_ = nullptr;
+  // Scratch space for assembling lexemes that cannot be viewed in the
+  // source. Reused across tokens to avoid allocating.
+  std::string lexeme_;
+  size_t tokensScanned_ = 0;
+  size_t bytesScanned_ = 0;
 };
 
-template <typename Iterator> Token Scanner<Iterator>::next() {
-  prev_ = i_;
+template <typename Iterator> Token Scanner<Iterator>::scan() {
   while (i_ != e_) {
-    auto c = *i_;
-    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_') {
-      return scanIdentifier();
-    } else if (c >= '0' && c <= '9') {
-      return scanNumber();
-    } else if (c == '"') {
-      return scanString();
-    } else if (c == ' ' || c == '\t' || c == '\n') {
-      ++i_;  // skip whitespace
-    } else if (c == '(') {
-      return Token(TokenType::LEFT_PAREN, "(", i_++ - b_);
-    } else if (c == ')') {
-      return Token(TokenType::RIGHT_PAREN, ")", i_++ - b_);
-    } else if (c == '{') {
-      return Token(TokenType::LEFT_BRACE, "{", i_++ - b_);
-    } else if (c == '}') {
-      return Token(TokenType::RIGHT_BRACE, "}", i_++ - b_);
-    } else if (c == ',') {
-      return Token(TokenType::COMMA, ",", i_++ - b_);
-    } else if (c == '.') {
-      return Token(TokenType::DOT, ".", i_++ - b_);
-    } else if (c == '-') {
-      return Token(TokenType::MINUS, "-", i_++ - b_);
-    } else if (c == '+') {
-      return Token(TokenType::PLUS, "+", i_++ - b_);
-    } else if (c == ';') {
-      return Token(TokenType::SEMICOLON, ";", i_++ - b_);
-    } else if (c == '/') {
-      i_++;  // consume the /
-      if (i_ == e_ || *i_ != '/') {  // not a comment.
-        return Token(TokenType::SLASH, "/", i_ - 1 - b_);
-      }
-      while (i_ < e_ && *i_ != '\n') ++i_;  // skip the comment.
-    } else if (c == '*') {
-      return Token(TokenType::STAR, "*", i_++ - b_);
-    } else if (c == '!') {
-      i_++;
-      if (i_ == e_ || *i_ != '=') {
-        return Token(TokenType::BANG, "!", i_ - 1 - b_);
-      }
-      return Token(TokenType::BANG_EQUAL, "!=", i_++ - 1 - b_);
-    } else if (c == '=') {
-      i_++;
-      if (i_ == e_ || *i_ != '=') {
-        return Token(TokenType::EQUAL, "=", i_ - 1 - b_);
-      }
-      return Token(TokenType::EQUAL_EQUAL, "==", i_++ - 1 - b_);
-    } else if (c == '>') {
-      i_++;
-      if (i_ == e_ || *i_ != '=') {
-        return Token(TokenType::GREATER, ">", i_ - 1 - b_);
-      }
-      return Token(TokenType::GREATER_EQUAL, ">=", i_++ - 1 - b_);
-    } else if (c == '<') {
-      i_++;
-      if (i_ == e_ || *i_ != '=') {
-        return Token(TokenType::LESS, "<", i_ - 1 - b_);
-      }
-      return Token(TokenType::LESS_EQUAL, "<=", i_++ - 1 - b_);
-    } else {
-      err_->report(
-          i_ - b_, fmt::format("Unexpected char: '{:c}'[0x{:x}]", *i_, *i_));
-      i_++;  // skip unexpected character and continue scanning.
+    switch (internal::charClass(*i_)) {
+      case internal::CharClass::IDENTIFIER:
+        return scanIdentifier();
+      case internal::CharClass::DIGIT:
+        return scanNumber();
+      case internal::CharClass::QUOTE:
+        return scanString();
+      case internal::CharClass::OPERATOR:
+        return scanOperator();
+      case internal::CharClass::WHITESPACE:
+        advance();
+        if constexpr (kContiguous) {
+          skip(simd_->skipWhitespace, [](char c) {
+            return internal::charClass(c) == internal::CharClass::WHITESPACE;
+          });
+        }
+        break;
+      case internal::CharClass::SLASH:
+        advance();  // consume the /
+        if (i_ == e_ || *i_ != '/') {  // not a comment.
+          return makeToken(TokenType::SLASH, offset() - 1);
+        }
+        // skip the comment.
+        if constexpr (kContiguous) {
+          skip(simd_->findLineEnd, [](char c) { return c != '\n'; });
+        } else {
+          while (i_ != e_ && *i_ != '\n') advance();
+        }
+        break;
+      case internal::CharClass::INVALID:
+        err_->report(offset(), fmt::format("Unexpected char: '{:c}'[0x{:x}]",
+                                           *i_, *i_));
+        advance();  // skip unexpected character and continue scanning.
+        break;
     }
   }
-  return Token(TokenType::END_OF_FILE, "", e_ - b_);
+  return makeToken(TokenType::END_OF_FILE, offset());
+}
+
+// One- and two-character operators are resolved by a single lookup in the
+// transition table: the operator's second character, if any, decides
+// between the single and pair token without further branching on @c.
+template <typename Iterator> Token Scanner<Iterator>::scanOperator() {
+  const int location = offset();
+  const auto& op =
+      internal::kLexerTables.operators[static_cast<unsigned char>(*i_)];
+  advance();
+  const bool pair = op.second != 0 && i_ != e_ && *i_ == op.second;
+  if (pair) advance();
+  return makeToken(pair ? op.pair : op.single, location);
 }
 
 template <typename Iterator> Token Scanner<Iterator>::scanIdentifier() {
-  const int location = i_ - b_;
-  std::string identifier;
-  while (i_ < e_) {
-    auto c = *i_;
-    if ((c < 'A' || c > 'Z') && (c < 'a' || c > 'z') && c != '_' &&
-        (c < '0' || c > '9')) {
-      break;
+  const int location = offset();
+  lexeme_.clear();
+  if constexpr (kContiguous) {
+    skip(simd_->skipIdentifier, internal::isIdentifierChar);
+  } else {
+    while (i_ != e_ && internal::isIdentifierChar(*i_)) {
+      lexeme_.push_back(*i_);
+      advance();
     }
-    identifier.push_back(c);
-    ++i_;
   }
-  if (identifier == "and") {
-    return Token(TokenType::AND, identifier, location);
-  } else if (identifier == "class") {
-    return Token(TokenType::CLASS, identifier, location);
-  } else if (identifier == "else") {
-    return Token(TokenType::ELSE, identifier, location);
-  } else if (identifier == "exit") {
-    return Token(TokenType::EXIT, identifier, location);
-  } else if (identifier == "false") {
-    return Token(TokenType::FALSE, identifier, location);
-  } else if (identifier == "fun") {
-    return Token(TokenType::FUN, identifier, location);
-  } else if (identifier == "for") {
-    return Token(TokenType::FOR, identifier, location);
-  } else if (identifier == "if") {
-    return Token(TokenType::IF, identifier, location);
-  } else if (identifier == "nil") {
-    return Token(TokenType::NIL, identifier, location);
-  } else if (identifier == "or") {
-    return Token(TokenType::OR, identifier, location);
-  } else if (identifier == "print") {
-    return Token(TokenType::PRINT, identifier, location);
-  } else if (identifier == "return") {
-    return Token(TokenType::RETURN, identifier, location);
-  } else if (identifier == "super") {
-    return Token(TokenType::SUPER, identifier, location);
-  } else if (identifier == "this") {
-    return Token(TokenType::THIS, identifier, location);
-  } else if (identifier == "true") {
-    return Token(TokenType::TRUE, identifier, location);
-  } else if (identifier == "var") {
-    return Token(TokenType::VAR, identifier, location);
-  } else if (identifier == "while") {
-    return Token(TokenType::WHILE, identifier, location);
-  }
-  return Token(TokenType::IDENTIFIER, identifier, location);
+  const std::string_view identifier =
+      kContiguous ? source(location) : std::string_view(lexeme_);
+  const TokenType type = keywordType(identifier);
+  return makeToken(type, identifier, not kContiguous, location);
 }
 
 template <typename Iterator> Token Scanner<Iterator>::scanNumber() {
-  const int location = i_ - b_;
-  std::string number;
-  while (i_ < e_) {
-    if (*i_ < '0' || *i_ > '9') break;
-    number.push_back(*i_);
-    ++i_;
-  }
-  if (i_ < e_ && *i_ == '.') {  // scan fractional part as well.
-    number.push_back('.');
-    ++i_;
-    while (i_ < e_) {
-      if (*i_ < '0' && *i_ > '9') break;
-      number.push_back(*i_);
-      ++i_;
+  const int location = offset();
+  lexeme_.clear();
+  auto scanDigits = [this] {
+    if constexpr (kContiguous) {
+      skip(simd_->skipDigits, [](char c) { return c >= '0' && c <= '9'; });
+    } else {
+      while (i_ != e_) {
+        if (*i_ < '0' || *i_ > '9') break;
+        lexeme_.push_back(*i_);
+        advance();
+      }
     }
+  };
+  scanDigits();
+  if (i_ != e_ && *i_ == '.') {  // scan fractional part as well.
+    if constexpr (not kContiguous) lexeme_.push_back('.');
+    advance();
+    scanDigits();
   }
-  return Token(TokenType::NUMBER, number, location);
+  const std::string_view number =
+      kContiguous ? source(location) : std::string_view(lexeme_);
+  // A scratch number is left in lexeme_; see kTransientNumbers.
+  return makeToken(TokenType::NUMBER, number, false, location);
 }
 
+// The lexeme of a string token is its unescaped contents. When the source
+// is contiguous and the literal has no escapes, that is simply the text
+// between the quotes; otherwise it is assembled in lexeme_.
 template <typename Iterator> Token Scanner<Iterator>::scanString() {
-  const int location = i_ - b_;
-  std::string str;
-  i_++;  // consume beginning quote
+  const int location = offset();
+  lexeme_.clear();
+  bool scratch = not kContiguous;
+  advance();  // consume beginning quote
   bool escaped = false;
-  while (i_ < e_) {
-    auto c = *i_++;
+  while (i_ != e_) {
+    if constexpr (kContiguous) {
+      // Jump to the next quote or backslash, copying the run if the lexeme
+      // is being assembled.
+      if (not escaped) {
+        const char* run = base_ + (i_ - b_);
+        skip(simd_->findStringEnd,
+             [](char c) { return c != '"' && c != '\\'; });
+        if (scratch) lexeme_.append(run, base_ + (i_ - b_));
+        if (i_ == e_) break;
+      }
+    }
+    const char c = *i_;
+    advance();
     const bool escapedQuote = not escaped && c == '"';
     escaped = false;
     if (escapedQuote) {
-      return Token(TokenType::STRING, str, location);
+      const std::string_view str =
+          scratch ? std::string_view(lexeme_)
+                  : source(location + 1).substr(0, offset() - location - 2);
+      return makeToken(TokenType::STRING, str, scratch, location);
     } else if (c == '\\') {
+      if (not scratch) {
+        lexeme_.assign(base_ + location + 1, base_ + offset() - 1);
+        scratch = true;
+      }
       escaped = true;
-    } else {
-      str.push_back(c);
+    } else if (scratch) {
+      lexeme_.push_back(c);
     }
   }
   err_->report(location, "Unterminated string");
-  return Token(TokenType::STRING, str, location);
+  const std::string_view str =
+      scratch ? std::string_view(lexeme_) : source(location + 1);
+  return makeToken(TokenType::STRING, str, scratch, location);
 }
 
 }  // namespace lox
@@ -0,0 +1,233 @@
+#include "simd-scan.hpp"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOX_SIMD_X86 1
+#endif
+
+namespace lox {
+namespace simd {
+
+namespace {
+
+bool isWhitespace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+bool isIdentifier(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' ||
+         (c >= '0' && c <= '9');
+}
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+namespace generic {
+
+const char* skipWhitespace(const char* p, const char* end) {
+  while (p != end && isWhitespace(*p)) ++p;
+  return p;
+}
+const char* skipIdentifier(const char* p, const char* end) {
+  while (p != end && isIdentifier(*p)) ++p;
+  return p;
+}
+const char* skipDigits(const char* p, const char* end) {
+  while (p != end && isDigit(*p)) ++p;
+  return p;
+}
+const char* findLineEnd(const char* p, const char* end) {
+  while (p != end && *p != '\n') ++p;
+  return p;
+}
+const char* findStringEnd(const char* p, const char* end) {
+  while (p != end && *p != '"' && *p != '\\') ++p;
+  return p;
+}
+
+constexpr Kernels kKernels = {skipWhitespace, skipIdentifier, skipDigits,
+                              findLineEnd, findStringEnd};
+
+}  // namespace generic
+
+#ifdef LOX_SIMD_X86
+
+// Each kernel is written once as a template over a "stop" predicate that
+// maps a block of bytes to a mask with 0xff in the lanes that end the run.
+// Blocks are loaded unaligned; the tail shorter than a block is finished
+// with the scalar loop.
+
+namespace sse2 {
+
+// Lanes of @v in [lo, hi]. Bytes >= 0x80 compare as negative and are never
+// in range for the ASCII bounds used here.
+inline __m128i inRange(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+inline __m128i eq(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+inline __m128i notIn(__m128i in) {
+  return _mm_xor_si128(in, _mm_set1_epi8(-1));
+}
+
+struct NotWhitespace {
+  static __m128i stop(__m128i v) {
+    return notIn(_mm_or_si128(_mm_or_si128(eq(v, ' '), eq(v, '\t')),
+                              eq(v, '\n')));
+  }
+};
+struct NotIdentifier {
+  static __m128i stop(__m128i v) {
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return notIn(_mm_or_si128(
+        _mm_or_si128(inRange(lower, 'a', 'z'), inRange(v, '0', '9')),
+        eq(v, '_')));
+  }
+};
+struct NotDigit {
+  static __m128i stop(__m128i v) { return notIn(inRange(v, '0', '9')); }
+};
+struct LineEnd {
+  static __m128i stop(__m128i v) { return eq(v, '\n'); }
+};
+struct StringEnd {
+  static __m128i stop(__m128i v) {
+    return _mm_or_si128(eq(v, '"'), eq(v, '\\'));
+  }
+};
+
+template <typename Pred, bool (*kScalarContinue)(char)>
+const char* scan(const char* p, const char* end) {
+  while (end - p >= 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const int mask = _mm_movemask_epi8(Pred::stop(v));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  while (p != end && kScalarContinue(*p)) ++p;
+  return p;
+}
+
+bool notLineEnd(char c) { return c != '\n'; }
+bool notStringEnd(char c) { return c != '"' && c != '\\'; }
+
+constexpr Kernels kKernels = {
+    scan<NotWhitespace, isWhitespace>, scan<NotIdentifier, isIdentifier>,
+    scan<NotDigit, isDigit>, scan<LineEnd, notLineEnd>,
+    scan<StringEnd, notStringEnd>};
+
+}  // namespace sse2
+
+#define LOX_AVX2 __attribute__((target("avx2")))
+
+namespace avx2 {
+
+LOX_AVX2 inline __m256i inRange(__m256i v, char lo, char hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+LOX_AVX2 inline __m256i eq(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+LOX_AVX2 inline __m256i notIn(__m256i in) {
+  return _mm256_xor_si256(in, _mm256_set1_epi8(-1));
+}
+
+struct NotWhitespace {
+  LOX_AVX2 static __m256i stop(__m256i v) {
+    return notIn(_mm256_or_si256(_mm256_or_si256(eq(v, ' '), eq(v, '\t')),
+                                 eq(v, '\n')));
+  }
+};
+struct NotIdentifier {
+  LOX_AVX2 static __m256i stop(__m256i v) {
+    const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return notIn(_mm256_or_si256(
+        _mm256_or_si256(inRange(lower, 'a', 'z'), inRange(v, '0', '9')),
+        eq(v, '_')));
+  }
+};
+struct NotDigit {
+  LOX_AVX2 static __m256i stop(__m256i v) {
+    return notIn(inRange(v, '0', '9'));
+  }
+};
+struct LineEnd {
+  LOX_AVX2 static __m256i stop(__m256i v) { return eq(v, '\n'); }
+};
+struct StringEnd {
+  LOX_AVX2 static __m256i stop(__m256i v) {
+    return _mm256_or_si256(eq(v, '"'), eq(v, '\\'));
+  }
+};
+
+// Runs shorter than a 32-byte block, the common case for identifiers and
+// numbers, are finished by the 16-byte SSE2 kernel.
+template <typename Pred, typename Sse2Pred, bool (*kScalarContinue)(char)>
+LOX_AVX2 const char* scan(const char* p, const char* end) {
+  while (end - p >= 32) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const unsigned mask = _mm256_movemask_epi8(Pred::stop(v));
+    if (mask != 0) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return sse2::scan<Sse2Pred, kScalarContinue>(p, end);
+}
+
+constexpr Kernels kKernels = {
+    scan<NotWhitespace, sse2::NotWhitespace, isWhitespace>,
+    scan<NotIdentifier, sse2::NotIdentifier, isIdentifier>,
+    scan<NotDigit, sse2::NotDigit, isDigit>,
+    scan<LineEnd, sse2::LineEnd, sse2::notLineEnd>,
+    scan<StringEnd, sse2::StringEnd, sse2::notStringEnd>};
+
+}  // namespace avx2
+
+#endif  // LOX_SIMD_X86
+
+std::atomic<const Kernels*> activeKernels{nullptr};
+
+}  // namespace
+
+Level detectLevel() {
+#ifdef LOX_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+  if (__builtin_cpu_supports("sse2")) return Level::SSE2;
+#endif
+  return Level::GENERIC;
+}
+
+const Kernels& kernels(Level level) {
+#ifdef LOX_SIMD_X86
+  const Level best = detectLevel();
+  if (level > best) level = best;
+  switch (level) {
+    case Level::AVX2:
+      return avx2::kKernels;
+    case Level::SSE2:
+      return sse2::kKernels;
+    case Level::GENERIC:
+      break;
+  }
+#else
+  (void)level;
+#endif
+  return generic::kKernels;
+}
+
+const Kernels& active() {
+  const Kernels* k = activeKernels.load(std::memory_order_acquire);
+  if (k == nullptr) {
+    k = &kernels(detectLevel());
+    activeKernels.store(k, std::memory_order_release);
+  }
+  return *k;
+}
+
+void setLevel(Level level) {
+  activeKernels.store(&kernels(level), std::memory_order_release);
+}
+
+}  // namespace simd
+}  // namespace lox
@@ -0,0 +1,37 @@
+#pragma once
+
+namespace lox {
+namespace simd {
+
+// Bulk character-run kernels used by the Scanner on contiguous sources. Each
+// kernel scans [p, end) and returns a pointer to the first character that
+// ends the run, or @end if the run reaches it.
+struct Kernels {
+  // First character that is not ' ', '\t' or '\n'.
+  const char* (*skipWhitespace)(const char* p, const char* end);
+  // First character that is not [A-Za-z0-9_].
+  const char* (*skipIdentifier)(const char* p, const char* end);
+  // First character that is not [0-9].
+  const char* (*skipDigits)(const char* p, const char* end);
+  // First '\n'.
+  const char* (*findLineEnd)(const char* p, const char* end);
+  // First '"' or '\\'.
+  const char* (*findStringEnd)(const char* p, const char* end);
+};
+
+enum class Level { GENERIC, SSE2, AVX2 };
+
+// Best level supported by the CPU we are running on.
+Level detectLevel();
+// Kernels implementing @level. Levels the CPU or the build does not support
+// fall back to the best supported one below them.
+const Kernels& kernels(Level level);
+
+// Kernels the Scanner uses. They are selected from detectLevel() the first
+// time they are needed; tests and benchmarks may override the choice with
+// setLevel().
+const Kernels& active();
+void setLevel(Level level);
+
+}  // namespace simd
+}  // namespace lox
@@ -0,0 +1,63 @@
+#include "source-file.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lox {
+
+namespace {
+
+bool readAll(int fd, std::string* out) {
+  char chunk[64 << 10];
+  while (true) {
+    const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n == 0) return true;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    out->append(chunk, n);
+  }
+}
+
+}  // namespace
+
+bool SourceFile::open(const char* filename) {
+  close();
+  const int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  bool ok = ::fstat(fd, &st) == 0;
+  if (ok && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      // The scanner makes a single front-to-back pass over the source.
+      ::madvise(p, st.st_size, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(p);
+      size_ = st.st_size;
+      mapped_ = true;
+    }
+  }
+  if (ok && not mapped_) {
+    ok = readAll(fd, &buffer_);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+  }
+  ::close(fd);
+  if (not ok) close();
+  return ok;
+}
+
+void SourceFile::close() {
+  if (mapped_) ::munmap(const_cast<char*>(data_), size_);
+  data_ = "";
+  size_ = 0;
+  mapped_ = false;
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+}
+
+}  // namespace lox
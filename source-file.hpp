@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace lox {
+
+// Read-only view of a program file. Regular files are memory-mapped, so
+// opening one costs no copy and pages are faulted in as the scanner reaches
+// them. Anything that cannot be mapped (pipes, character devices) is read
+// into an owned buffer instead. Tokens scanned from the contents point into
+// this object, which must therefore outlive them.
+class SourceFile {
+ public:
+  SourceFile() = default;
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+  ~SourceFile() { close(); }
+
+  // Opens @filename, replacing any previously opened contents. Returns
+  // false if the file cannot be opened or read.
+  bool open(const char* filename);
+  void close();
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+  std::string_view view() const { return {data_, size_}; }
+  bool mapped() const { return mapped_; }
+
+ private:
+  const char* data_ = "";
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::string buffer_;  // contents of files that could not be mapped.
+};
+
+}  // namespace lox
@@ -0,0 +1,166 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <fmt/format.h>
+#include <iterator>
+#include <vector>
+
+namespace lox {
+
+namespace {
+
+double threadCpuSeconds() {
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Average time between two reads of the wall clock, which every sample
+// includes on top of the stretch it times.
+double sampleOverhead() {
+  constexpr int kSamples = 256;
+  const auto start = std::chrono::steady_clock::now();
+  auto stop = start;
+  for (int i = 0; i < kSamples; ++i) stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(stop - start).count() / kSamples;
+}
+
+const char* const kNodeKindNames[] = {"number", "string", "bool",
+                                      "nil",    "unary",  "binary"};
+static_assert(std::size(kNodeKindNames) == kNumNodeKinds);
+
+}  // namespace
+
+void Stats::merge(const Stats& other) {
+  for (size_t i = 0; i < NUM_PHASES; ++i) {
+    phases[i].wallSeconds += other.phases[i].wallSeconds;
+    phases[i].cpuSeconds += other.phases[i].cpuSeconds;
+    phases[i].bytesAllocated += other.phases[i].bytesAllocated;
+  }
+  for (size_t i = 0; i < kNumTokenTypes; ++i) tokens[i] += other.tokens[i];
+  for (size_t i = 0; i < kNumNodeKinds; ++i) nodes[i] += other.nodes[i];
+  evalVisits += other.evalVisits;
+  typeErrors += other.typeErrors;
+  programs += other.programs;
+}
+
+void Stats::countNodes(const ast::Node* root) {
+  if (not kStatsEnabled || not root) return;
+  // Trees can be far deeper than the native stack allows recursing.
+  std::vector<const ast::Node*> stack = {root};
+  while (not stack.empty()) {
+    const ast::Node* node = stack.back();
+    stack.pop_back();
+    ++nodes[static_cast<size_t>(node->kind)];
+    if (node->kind == ast::Node::Kind::UNARY) {
+      stack.push_back(static_cast<const ast::Unary*>(node)->operand);
+    } else if (node->kind == ast::Node::Kind::BINARY) {
+      const auto* binary = static_cast<const ast::Binary*>(node);
+      stack.push_back(binary->second);
+      stack.push_back(binary->first);
+    }
+  }
+}
+
+void Stats::countNodes(const ast::FlatTree& tree) {
+  if (not kStatsEnabled) return;
+  // FlatTree::Kind lists the kinds in the same order as ast::Node::Kind.
+  for (ast::FlatTree::Index i = 0; i < tree.size(); ++i) {
+    ++nodes[static_cast<size_t>(tree.kind(i))];
+  }
+}
+
+void Stats::print(std::ostream& out) const {
+  out << fmt::format("{:<8}{:>12}{:>12}{:>16}\n", "phase", "wall ms",
+                     "cpu ms", "alloc bytes");
+  for (size_t i = 0; i < NUM_PHASES; ++i) {
+    out << fmt::format("{:<8}{:>12.3f}{:>12.3f}{:>16}\n",
+                       phaseName(static_cast<Phase>(i)),
+                       phases[i].wallSeconds * 1e3,
+                       phases[i].cpuSeconds * 1e3,
+                       phases[i].bytesAllocated);
+  }
+  out << fmt::format("programs: {}, evaluator visits: {}, type errors: {}\n",
+                     programs, evalVisits, typeErrors);
+  out << "tokens:";
+  for (size_t i = 0; i < kNumTokenTypes; ++i) {
+    if (tokens[i] == 0) continue;
+    out << fmt::format(" {}={}",
+                       tokenTypeToString(static_cast<TokenType>(i)),
+                       tokens[i]);
+  }
+  out << "\nnodes:";
+  for (size_t i = 0; i < kNumNodeKinds; ++i) {
+    if (nodes[i] == 0) continue;
+    out << fmt::format(" {}={}", kNodeKindNames[i], nodes[i]);
+  }
+  out << "\n";
+}
+
+const char* Stats::phaseName(Phase phase) {
+  switch (phase) {
+    case READ: return "read";
+    case SCAN: return "scan";
+    case PARSE: return "parse";
+    case EVAL: return "eval";
+    case PRINT: return "print";
+    case NUM_PHASES: break;
+  }
+  return "?";
+}
+
+void PhaseTimer::start() {
+  outer_ = stats_->timer;
+  stats_->timer = this;
+  wall_ = std::chrono::steady_clock::now();
+  cpu_ = threadCpuSeconds();
+  bytes_ = threadBytesAllocated();
+}
+
+void PhaseTimer::stop() {
+  const double wall = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - wall_).count();
+  const double cpu = threadCpuSeconds() - cpu_;
+  const uint64_t bytes = threadBytesAllocated() - bytes_;
+  Stats::PhaseStats& phase = stats_->phases[phase_];
+  phase.wallSeconds += wall;
+  phase.cpuSeconds += cpu;
+  phase.bytesAllocated += bytes;
+  if (sampledWall_ > 0 && wall > 0) {
+    const double share = std::min(sampledWall_ / wall, 1.0);
+    Stats::PhaseStats& sampled = stats_->phases[sampledPhase_];
+    sampled.wallSeconds += share * wall;
+    sampled.cpuSeconds += share * cpu;
+    phase.wallSeconds -= share * wall;
+    phase.cpuSeconds -= share * cpu;
+  }
+  if (outer_) {
+    Stats::PhaseStats& outer = stats_->phases[outer_->phase_];
+    outer.wallSeconds -= wall;
+    outer.cpuSeconds -= cpu;
+    outer.bytesAllocated -= bytes;
+  }
+  stats_->timer = outer_;
+}
+
+void PhaseSampler::addBytes(uint64_t bytes) {
+  stats_->phases[phase_].bytesAllocated += bytes;
+  if (stats_->timer) {
+    stats_->phases[stats_->timer->phase_].bytesAllocated -= bytes;
+  }
+}
+
+void PhaseSampler::addSample() {
+  const auto stop = std::chrono::steady_clock::now();
+  PhaseTimer* timer = stats_->timer;
+  if (not timer) return;
+  static const double overhead = sampleOverhead();
+  // Single samples may come out negative; only their sum means anything.
+  timer->sampledWall_ +=
+      (std::chrono::duration<double>(stop - wall_).count() - overhead) *
+      kInterval;
+  timer->sampledPhase_ = phase_;
+}
+
+}  // namespace lox
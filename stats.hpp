@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "ast.hpp"
+#include "flat-ast.hpp"
+#include "token-type.hpp"
+#include "trace.hpp"
+
+// Statistics are compiled in unless built with -DLOX_STATS=0, which turns
+// every hook below into a no-op. Allocations are only counted in binaries
+// that link alloc-counter, which replaces the global operator new.
+#ifndef LOX_STATS
+#define LOX_STATS 1
+#endif
+
+namespace lox {
+
+class PhaseTimer;
+
+inline constexpr bool kStatsEnabled = LOX_STATS;
+
+inline constexpr size_t kNumTokenTypes =
+    static_cast<size_t>(TokenType::NUMBER) + 1;
+inline constexpr size_t kNumNodeKinds =
+    static_cast<size_t>(ast::Node::Kind::BINARY) + 1;
+
+// Counters describing what the interpreter did, for finding out where the
+// time goes in a slow run. Phases are timed separately on every thread and
+// added up, so in --batch mode their times are total busy time across the
+// workers rather than elapsed time. A phase timed within another, such as
+// the scanning the parser drives, counts for the inner phase only.
+struct Stats {
+  enum Phase { READ, SCAN, PARSE, EVAL, PRINT, NUM_PHASES };
+  struct PhaseStats {
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    // Bytes requested from operator new while in the phase.
+    uint64_t bytesAllocated = 0;
+  };
+
+  std::array<PhaseStats, NUM_PHASES> phases;
+  // Tokens by TokenType, counted as the parser's TokenStream scans them.
+  std::array<uint64_t, kNumTokenTypes> tokens{};
+  // Syntax tree nodes by ast::Node::Kind.
+  std::array<uint64_t, kNumNodeKinds> nodes{};
+  // Nodes evaluated by the tree-walking Evaluator.
+  uint64_t evalVisits = 0;
+  // Programs that stopped on a runtime type error.
+  uint64_t typeErrors = 0;
+  uint64_t programs = 0;
+  // Innermost PhaseTimer running on these stats, if any.
+  PhaseTimer* timer = nullptr;
+
+  void merge(const Stats& other);
+  void countNodes(const ast::Node* root);
+  void countNodes(const ast::FlatTree& tree);
+  // Writes a human-readable report to @out.
+  void print(std::ostream& out) const;
+
+  static const char* phaseName(Phase phase);
+};
+
+namespace internal {
+// Incremented by the operator new of alloc-counter.
+inline thread_local uint64_t bytesAllocated = 0;
+}  // namespace internal
+
+// Bytes the calling thread has requested from operator new so far; always 0
+// when statistics are compiled out or alloc-counter is not linked in.
+inline uint64_t threadBytesAllocated() {
+  return kStatsEnabled ? internal::bytesAllocated : 0;
+}
+
+// Adds the time and allocations between its construction and destruction
+// to one phase of @stats, unless @stats is null, and records the phase as a
+// trace span while tracing. Timers on the same Stats must nest; an inner
+// one takes what it adds back out of the phase of the outer one.
+class PhaseTimer {
+ public:
+  PhaseTimer(Stats* stats, Stats::Phase phase)
+    : span_(Stats::phaseName(phase)),
+      stats_(kStatsEnabled ? stats : nullptr),
+      phase_(phase) {
+    if (stats_) start();
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+  ~PhaseTimer() {
+    if (stats_) stop();
+  }
+
+ private:
+  friend class PhaseSampler;
+
+  void start();
+  void stop();
+
+  trace::Span span_;
+  Stats* stats_;
+  Stats::Phase phase_;
+  PhaseTimer* outer_ = nullptr;
+  std::chrono::steady_clock::time_point wall_;
+  double cpu_ = 0;
+  uint64_t bytes_ = 0;
+  // Estimated wall time of the stretches a PhaseSampler added to
+  // @sampledPhase_ while this was the innermost timer.
+  double sampledWall_ = 0;
+  Stats::Phase sampledPhase_ = Stats::NUM_PHASES;
+};
+
+// Adds to one phase of @stats the many short stretches of work, such as
+// scanning a single token, between matching begin() and end() calls, and
+// takes them out of the phase of the innermost PhaseTimer running on
+// @stats. Reading the clocks around every stretch would cost more than the
+// work, so only one in kInterval is timed, on the wall clock only, and
+// counts for kInterval of them. When the timer stops, that estimate of the
+// stretches' share of its wall time moves the same share of its wall and
+// CPU time to the phase. Allocations are counted exactly. Stretches outside
+// any PhaseTimer are not timed.
+class PhaseSampler {
+ public:
+  static constexpr uint32_t kInterval = 64;
+
+  PhaseSampler(Stats* stats, Stats::Phase phase)
+    : stats_(kStatsEnabled ? stats : nullptr), phase_(phase) {}
+
+  // Must only be called with non-null stats.
+  void begin() {
+    bytes_ = threadBytesAllocated();
+    if (--countdown_ == 0) {
+      countdown_ = kInterval;
+      wall_ = std::chrono::steady_clock::now();
+    }
+  }
+  void end() {
+    const uint64_t bytes = threadBytesAllocated() - bytes_;
+    if (bytes != 0) addBytes(bytes);
+    if (countdown_ == kInterval) addSample();
+  }
+
+ private:
+  void addBytes(uint64_t bytes);
+  void addSample();
+
+  Stats* stats_;
+  Stats::Phase phase_;
+  // The first stretch is timed, so that short runs get an estimate too.
+  uint32_t countdown_ = 1;
+  uint64_t bytes_ = 0;
+  std::chrono::steady_clock::time_point wall_;
+};
+
+}  // namespace lox
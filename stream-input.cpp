@@ -0,0 +1,25 @@
+#include "stream-input.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace lox {
+
+bool StreamInput::fill() {
+  if (pos_ < len_) return true;
+  while (not eof_) {
+    const ssize_t n = ::read(fd_, buf_.get(), chunkSize_);
+    if (n > 0) {
+      pos_ = 0;
+      len_ = n;
+      bytesRead_ += n;
+      return true;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    failed_ = n < 0;
+    eof_ = true;
+  }
+  return false;
+}
+
+}  // namespace lox
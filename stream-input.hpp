@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+
+namespace lox {
+
+// Adapts a file descriptor, typically stdin or a pipe, into a single-pass
+// input range for the Scanner. Input is read with read(2) in fixed-size
+// chunks into one bounded buffer that is reused for every chunk, so memory
+// use does not depend on the length of the input. Intended usage:
+//   StreamInput in(STDIN_FILENO);
+//   Parser parser(&err, in.begin(), in.end());
+//
+// Iterators are input iterators: advancing one invalidates all its copies,
+// and only one pass over the input is possible.
+class StreamInput {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 << 10;
+
+  explicit StreamInput(int fd, size_t chunkSize = kDefaultChunkSize)
+    : fd_(fd), chunkSize_(chunkSize), buf_(new char[chunkSize]) {}
+  StreamInput(const StreamInput&) = delete;
+  StreamInput& operator=(const StreamInput&) = delete;
+
+  class Iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+
+    Iterator() = default;
+    reference operator*() const { return in_->buf_[in_->pos_]; }
+    Iterator& operator++() {
+      ++in_->pos_;
+      return *this;
+    }
+    // Post-increment yields the character before the increment.
+    struct Proxy {
+      char c;
+      char operator*() const { return c; }
+    };
+    Proxy operator++(int) {
+      Proxy p{**this};
+      ++*this;
+      return p;
+    }
+    // All iterators at the end of the input compare equal.
+    bool operator==(const Iterator& o) const { return atEnd() == o.atEnd(); }
+    bool operator!=(const Iterator& o) const { return not(*this == o); }
+
+   private:
+    friend class StreamInput;
+    explicit Iterator(StreamInput* in) : in_(in) {}
+    bool atEnd() const { return in_ == nullptr || not in_->fill(); }
+
+    StreamInput* in_ = nullptr;
+  };
+
+  Iterator begin() { return Iterator(this); }
+  Iterator end() { return Iterator(); }
+
+  // Total bytes read from the descriptor so far.
+  size_t bytesRead() const { return bytesRead_; }
+  // Size of the internal buffer; the most memory input ever occupies.
+  size_t chunkSize() const { return chunkSize_; }
+  // True if reading stopped because of an error rather than end of input.
+  bool failed() const { return failed_; }
+
+ private:
+  // Makes sure the current character is buffered, reading the next chunk
+  // once the buffer is exhausted. Returns false at end of input.
+  bool fill();
+
+  int fd_;
+  size_t chunkSize_;
+  std::unique_ptr<char[]> buf_;
+  size_t pos_ = 0;  // current character in buf_.
+  size_t len_ = 0;  // bytes of buf_ holding input.
+  size_t bytesRead_ = 0;
+  bool eof_ = false;
+  bool failed_ = false;
+};
+
+}  // namespace lox
@@ -0,0 +1,99 @@
+#include "thread-pool.hpp"
+
+#include <algorithm>
+
+namespace lox {
+
+ThreadPool::ThreadPool(size_t threads)
+  : size_(threads > 0 ? threads
+                      : std::max(1u, std::thread::hardware_concurrency())),
+    ranges_(new Range[size_]) {
+  threads_.reserve(size_ - 1);
+  for (size_t i = 1; i < size_; ++i) {
+    threads_.emplace_back([this, i] { loop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+void ThreadPool::parallelFor(size_t numTasks,
+                             const std::function<void(size_t, size_t)>& fn) {
+  if (numTasks == 0) return;
+  for (size_t i = 0; i < size_; ++i) {
+    std::lock_guard<std::mutex> lock(ranges_[i].mu);
+    ranges_[i].begin = numTasks * i / size_;
+    ranges_[i].end = numTasks * (i + 1) / size_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    fn_ = &fn;
+    running_ = threads_.size();
+    ++generation_;
+  }
+  start_.notify_all();
+  work(0);
+  std::unique_lock<std::mutex> lock(mu_);
+  done_.wait(lock, [this] { return running_ == 0; });
+  fn_ = nullptr;
+}
+
+void ThreadPool::loop(size_t worker) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) return;
+      seen = generation_;
+    }
+    work(worker);
+    std::lock_guard<std::mutex> lock(mu_);
+    if (--running_ == 0) done_.notify_one();
+  }
+}
+
+// Tasks are never added to a running batch, so once a worker finds every
+// range empty the only tasks left are already being run by other workers.
+void ThreadPool::work(size_t worker) {
+  size_t task;
+  while (pop(worker, &task) || steal(worker, &task)) (*fn_)(task, worker);
+}
+
+bool ThreadPool::pop(size_t worker, size_t* task) {
+  Range& own = ranges_[worker];
+  std::lock_guard<std::mutex> lock(own.mu);
+  if (own.begin == own.end) return false;
+  *task = own.begin++;
+  return true;
+}
+
+bool ThreadPool::steal(size_t worker, size_t* task) {
+  for (size_t i = 1; i < size_; ++i) {
+    Range& victim = ranges_[(worker + i) % size_];
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> lock(victim.mu);
+      if (victim.begin == victim.end) continue;
+      // Leave the victim the front half, which it is about to run anyway.
+      end = victim.end;
+      begin = victim.end - (victim.end - victim.begin + 1) / 2;
+      victim.end = begin;
+    }
+    Range& own = ranges_[worker];
+    std::lock_guard<std::mutex> lock(own.mu);
+    own.begin = begin + 1;
+    own.end = end;
+    *task = begin;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace lox
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lox {
+
+// Fixed set of worker threads that run batches of independent tasks. Each
+// batch is split into one contiguous range of task indices per worker.
+// Workers take tasks from the front of their own range and, once it is
+// empty, steal the back half of another worker's range, so uneven tasks
+// still keep every thread busy. Intended usage:
+//   ThreadPool pool(4);
+//   pool.parallelFor(n, [&](size_t task, size_t worker) { ... });
+//
+// The thread calling parallelFor() takes part as worker 0, so a pool of
+// one thread spawns nothing and runs every task inline.
+class ThreadPool {
+ public:
+  // Creates a pool of @threads workers, or one per hardware thread if 0.
+  explicit ThreadPool(size_t threads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  size_t size() const { return size_; }
+
+  // Calls @fn(task, worker) once for every task in [0, @numTasks) and
+  // returns when all calls have finished. The worker index is in
+  // [0, size()) and no two calls with the same index run at once, so it can
+  // select per-thread state. @fn must not throw. Not reentrant.
+  void parallelFor(size_t numTasks,
+                   const std::function<void(size_t, size_t)>& fn);
+
+ private:
+  // Half-open range of task indices owned by one worker.
+  struct alignas(64) Range {
+    std::mutex mu;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  void loop(size_t worker);
+  void work(size_t worker);
+  bool pop(size_t worker, size_t* task);
+  bool steal(size_t worker, size_t* task);
+
+  const size_t size_;
+  std::unique_ptr<Range[]> ranges_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mu_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(size_t, size_t)>* fn_ = nullptr;
+  uint64_t generation_ = 0;  // incremented for every batch.
+  size_t running_ = 0;       // spawned workers still busy with the batch.
+  bool stop_ = false;
+};
+
+}  // namespace lox
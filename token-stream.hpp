@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "error-reporter.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+#include "token.hpp"
+
+namespace lox {
+
+// Buffers the tokens produced by a Scanner so that a parser can look ahead
+// any number of tokens without re-scanning. Each token is lexed exactly once
+// into a ring buffer, which grows only when a caller looks further ahead
+// than it has ever done before. Intended usage as follows:
+//   TokenStream tokens(&err, begin, end);
+//   if (tokens.peek().type() == TokenType::MINUS) {
+//     auto minus = tokens.advance();
+//     ...
+//   }
+//
+// Tokens keep the lexemes the scanner gave them, except that numbers from
+// a scanner with transient lexemes are copied into the slot buffering them.
+// The lexeme of such a number is valid until the next call to peek() or
+// advance().
+template <typename Iterator> class TokenStream {
+ public:
+  static constexpr size_t kInitialCapacity = 8;
+
+  TokenStream(ErrorReporter* err, Iterator begin, Iterator end)
+    : s_(err, begin, end), buf_(kInitialCapacity) {
+    if constexpr (kCopyNumbers) numbers_.resize(kInitialCapacity);
+  }
+
+  // Returns the token @k positions ahead of the current one without
+  // consuming anything. peek(0) is the token advance() returns next. Past
+  // the end of input every position holds the END_OF_FILE token.
+  const Token& peek(size_t k = 0) {
+    while (count_ <= k) fill();
+    return buf_[(head_ + k) & (buf_.size() - 1)];
+  }
+  // Consumes and returns the current token.
+  Token advance() {
+    const Token token = peek();
+    head_ = (head_ + 1) & (buf_.size() - 1);
+    --count_;
+    return token;
+  }
+  // The scanner feeding this stream, e.g. to inspect its counters.
+  const Scanner<Iterator>& scanner() const { return s_; }
+  // Counts the tokens scanned from now on in @stats, and adds scanning them
+  // to its SCAN phase. Tokens are still scanned only as they are needed,
+  // so the scanner reports exactly the same errors.
+  void setStats(Stats* stats) {
+    stats_ = kStatsEnabled ? stats : nullptr;
+    scan_ = PhaseSampler(stats_, Stats::SCAN);
+  }
+
+ private:
+  static constexpr bool kCopyNumbers = Scanner<Iterator>::kTransientNumbers;
+
+  void fill() {
+    if (not stats_) {
+      push(s_.next());
+      return;
+    }
+    scan_.begin();
+    const Token token = s_.next();
+    scan_.end();
+    // The scanner keeps returning END_OF_FILE; count it once.
+    if (not ended_) ++stats_->tokens[static_cast<size_t>(token.type())];
+    ended_ = token.type() == TokenType::END_OF_FILE;
+    push(token);
+  }
+  void push(const Token& token) {
+    if (count_ == buf_.size()) grow();
+    const size_t slot = (head_ + count_) & (buf_.size() - 1);
+    buf_[slot] = token;
+    if constexpr (kCopyNumbers) {
+      if (token.type() == TokenType::NUMBER) {
+        numbers_[slot].assign(token.lexeme());
+        buf_[slot] = Token(TokenType::NUMBER, numbers_[slot],
+                           token.location());
+      }
+    }
+    ++count_;
+  }
+  // Doubles the capacity, unrolling the buffered tokens to the front.
+  void grow() {
+    std::vector<Token> grown(buf_.size() * 2);
+    std::vector<std::string> numbers(kCopyNumbers ? grown.size() : 0);
+    for (size_t i = 0; i < count_; ++i) {
+      const size_t slot = (head_ + i) & (buf_.size() - 1);
+      grown[i] = buf_[slot];
+      if constexpr (kCopyNumbers) {
+        // Moving a short string moves its characters, so the token is
+        // pointed at the new copy.
+        if (grown[i].type() == TokenType::NUMBER) {
+          numbers[i] = std::move(numbers_[slot]);
+          grown[i] = Token(TokenType::NUMBER, numbers[i],
+                           grown[i].location());
+        }
+      }
+    }
+    buf_.swap(grown);
+    numbers_.swap(numbers);
+    head_ = 0;
+  }
+
+  Scanner<Iterator> s_;
+  std::vector<Token> buf_;  // capacity is always a power of two.
+  // Lexemes of the buffered numbers, by slot, with kCopyNumbers.
+  std::vector<std::string> numbers_;
+  size_t head_ = 0;         // index of the current token.
+  size_t count_ = 0;        // number of buffered tokens.
+  Stats* stats_ = nullptr;
+  PhaseSampler scan_{nullptr, Stats::SCAN};
+  bool ended_ = false;  // END_OF_FILE was scanned, while collecting Stats.
+};
+
+}  // namespace lox
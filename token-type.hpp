@@ -1,11 +1,15 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace lox {
 
 // This enum describes all the types of tokens that comprise the Lox language.
-enum class TokenType {
+enum class TokenType : uint8_t {
   // Simple "punctuation-style" operator tokens
   LEFT_PAREN,    // (
   RIGHT_PAREN,   // )
@@ -56,4 +60,87 @@ enum class TokenType {
 // Method to transform a TokenType @t into a human-readable string.
 std::string tokenTypeToString(TokenType t);
 
+namespace internal {
+
+// Spellings of the punctuation tokens, in TokenType order up to END_OF_FILE
+// (which is spelled as the empty string).
+inline constexpr std::string_view kOperatorLexemes[] = {
+    "(", ")", "{", "}", ",", ".", "-", "+", ";", "/",
+    "*", "!", "!=", "=", "==", ">", ">=", "<", "<=", ""};
+static_assert(std::size(kOperatorLexemes) ==
+                  static_cast<size_t>(TokenType::END_OF_FILE) + 1,
+              "kOperatorLexemes must list every punctuation TokenType");
+
+// Spellings of the reserved keywords, in TokenType order from AND to WHILE.
+inline constexpr std::string_view kKeywords[] = {
+    "and", "class", "else", "exit", "false", "fun", "for", "if", "nil",
+    "or", "print", "return", "super", "this", "true", "var", "while"};
+constexpr size_t kNumKeywords = std::size(kKeywords);
+static_assert(static_cast<size_t>(TokenType::WHILE) -
+                      static_cast<size_t>(TokenType::AND) + 1 ==
+                  kNumKeywords,
+              "kKeywords must list every keyword TokenType");
+
+// Keywords are recognized with a perfect hash over the length and the first
+// and last characters, which tells every keyword apart. The multipliers are
+// searched for at compile time, so editing the keyword list regenerates the
+// table (or fails to compile if no collision-free pair exists).
+constexpr size_t kKeywordTableSize = 64;
+
+constexpr size_t keywordHash(std::string_view s, size_t a, size_t b) {
+  return (static_cast<unsigned char>(s.front()) * a +
+          static_cast<unsigned char>(s.back()) * b + s.size()) &
+         (kKeywordTableSize - 1);
+}
+
+struct KeywordHash {
+  size_t a = 0;
+  size_t b = 0;
+  // Slot -> index into kKeywords, or kNumKeywords for empty slots.
+  std::array<uint8_t, kKeywordTableSize> slots{};
+};
+
+constexpr KeywordHash makeKeywordHash() {
+  for (size_t a = 1; a < kKeywordTableSize; ++a) {
+    for (size_t b = 1; b < kKeywordTableSize; ++b) {
+      KeywordHash h;
+      h.a = a;
+      h.b = b;
+      for (auto& slot : h.slots) slot = kNumKeywords;
+      bool collision = false;
+      for (size_t k = 0; k < kNumKeywords && not collision; ++k) {
+        auto& slot = h.slots[keywordHash(kKeywords[k], a, b)];
+        collision = slot != kNumKeywords;
+        slot = k;
+      }
+      if (not collision) return h;
+    }
+  }
+  return KeywordHash{};
+}
+
+inline constexpr KeywordHash kKeywordHash = makeKeywordHash();
+static_assert(kKeywordHash.a != 0, "No perfect hash for the keyword set");
+
+}  // namespace internal
+
+// Spelling of the punctuation tokens and EOF (which is spelled as the empty
+// string). Must only be called for types up to TokenType::END_OF_FILE.
+constexpr std::string_view operatorLexeme(TokenType t) {
+  return internal::kOperatorLexemes[static_cast<int>(t)];
+}
+
+// Classifies an identifier lexeme as a keyword or TokenType::IDENTIFIER. It
+// costs one hash and at most one string comparison.
+constexpr TokenType keywordType(std::string_view identifier) {
+  using namespace internal;
+  if (identifier.empty()) return TokenType::IDENTIFIER;
+  const size_t k = kKeywordHash.slots[keywordHash(
+      identifier, kKeywordHash.a, kKeywordHash.b)];
+  if (k == kNumKeywords || kKeywords[k] != identifier) {
+    return TokenType::IDENTIFIER;
+  }
+  return static_cast<TokenType>(static_cast<size_t>(TokenType::AND) + k);
+}
+
 }  // namespace lox
@@ -1,31 +1,49 @@
 #pragma once
 
+#include <cstdint>
 #include <fmt/format.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include "token-type.hpp"
 
 namespace lox {
 
 // Class that representes a Lox language token. These are produced by the
 // scanner class. Tokens consist of type, lexeme and location.
+//
+// Tokens are small and trivially copyable. The lexeme is not owned: it
+// points into the source buffer being scanned (or into storage that outlives
+// the source, such as the intern pool), so scanning does not allocate per
+// token and copying a token never copies its text.
 class Token {
 public:
-  Token() = default;
-  Token(TokenType type, std::string lexeme, int location)
-      : type_(type), lexeme_(lexeme), location_(location) {}
-  std::string debugString() {
+  // Longest lexeme a token can describe.
+  static constexpr uint32_t kMaxLexemeLength = (1u << 24) - 1;
+
+  Token() : lexeme_(""), location_(0), length_(0),
+            type_(TokenType::END_OF_FILE) {}
+  Token(TokenType type, std::string_view lexeme, int location)
+      : lexeme_(lexeme.data()), location_(location), length_(lexeme.size()),
+        type_(type) {}
+  std::string debugString() const {
     return fmt::format("{{type: {}, lexeme: '{}', location: {}}}",
-                       tokenTypeToString(type_), lexeme_, location_);
+                       tokenTypeToString(type()), lexeme(), location());
   }
 
   TokenType type() const { return type_; }
   int location() const { return location_; }
-  const std::string& lexeme() const { return lexeme_; }
+  std::string_view lexeme() const { return {lexeme_, length_}; }
 
 private:
-  TokenType type_;
-  std::string lexeme_;
-  int location_;
+  const char* lexeme_;
+  uint32_t location_;
+  uint32_t length_ : 24;
+  TokenType type_ : 8;
 };
 
+static_assert(std::is_trivially_copyable<Token>::value,
+              "Token must stay trivially copyable");
+static_assert(sizeof(Token) == 16, "Token must stay compact");
+
 }  // namespace lox
@@ -0,0 +1,125 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lox {
+namespace trace {
+
+namespace {
+
+struct Event {
+  const char* name;
+  uint64_t begin;
+  uint64_t end;
+  int64_t offset;
+};
+
+// Events of one thread. Only the owning thread appends to it, in chunks
+// that never move, so recording is a plain store.
+struct Buffer {
+  static constexpr size_t kChunk = 4096;
+
+  void append(const Event& event, size_t limit = kMaxEvents) {
+    if (size >= limit) {
+      ++dropped;
+      return;
+    }
+    if (size % kChunk == 0) chunks.emplace_back(new Event[kChunk]);
+    chunks.back()[size % kChunk] = event;
+    ++size;
+  }
+  const Event& operator[](size_t i) const {
+    return chunks[i / kChunk][i % kChunk];
+  }
+
+  uint32_t tid;
+  std::vector<std::unique_ptr<Event[]>> chunks;
+  size_t size = 0;
+  uint64_t dropped = 0;
+};
+
+std::atomic<int64_t> epoch{0};
+// Buffers of every thread that recorded something, kept past the thread's
+// exit until they are written.
+std::mutex buffersMutex;
+std::vector<std::unique_ptr<Buffer>> buffers;
+thread_local Buffer* threadBuffer = nullptr;
+
+int64_t steadyNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Buffer* localBuffer() {
+  if (not threadBuffer) {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    buffers.push_back(std::make_unique<Buffer>());
+    threadBuffer = buffers.back().get();
+    threadBuffer->tid = buffers.size();
+  }
+  return threadBuffer;
+}
+
+}  // namespace
+
+void start(uint32_t sampleInterval) {
+  epoch.store(steadyNanos(), std::memory_order_relaxed);
+  internal::sampleInterval.store(sampleInterval, std::memory_order_relaxed);
+  internal::enabled.store(true, std::memory_order_release);
+}
+
+uint64_t now() {
+  return steadyNanos() - epoch.load(std::memory_order_relaxed);
+}
+
+void record(const char* name, uint64_t begin, uint64_t end,
+            int64_t offset) {
+  localBuffer()->append({name, begin, end, offset});
+}
+
+void recordSample(const char* name, uint64_t begin, uint64_t end,
+                  int64_t offset) {
+  localBuffer()->append({name, begin, end, offset},
+                        kMaxEvents - kReservedEvents);
+}
+
+bool write(const std::string& path) {
+  internal::enabled.store(false, std::memory_order_relaxed);
+  std::FILE* f = std::fopen(path.c_str(), "w");
+  if (not f) return false;
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  fmt::print(f, "{{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fmt::print(f, "{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"args\":{{\"name\":\"lox\"}}}}");
+  for (const auto& buffer : buffers) {
+    fmt::print(f,
+               ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"tid\":{},\"args\":{{\"name\":\"thread {}\","
+               "\"dropped_events\":{}}}}}",
+               buffer->tid, buffer->tid, buffer->dropped);
+    for (size_t i = 0; i < buffer->size; ++i) {
+      const Event& e = (*buffer)[i];
+      fmt::print(f,
+                 ",\n{{\"name\":\"{}\",\"cat\":\"lox\",\"ph\":\"X\","
+                 "\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}",
+                 e.name, buffer->tid, e.begin / 1e3,
+                 (e.end - e.begin) / 1e3);
+      if (e.offset >= 0) {
+        fmt::print(f, ",\"args\":{{\"offset\":{}}}", e.offset);
+      }
+      fmt::print(f, "}}");
+    }
+  }
+  fmt::print(f, "\n]}}\n");
+  const bool ok = not std::ferror(f);
+  return std::fclose(f) == 0 && ok;
+}
+
+}  // namespace trace
+}  // namespace lox
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace lox {
+namespace trace {
+
+// Timeline of spans in the Chrome trace-event format, which chrome://tracing
+// and Perfetto display. Usage:
+//   trace::start();
+//   { trace::Span span("parse"); ... }
+//   trace::write("trace.json");
+//
+// Every thread appends to a buffer of its own, so recording takes no locks
+// and costs two clock reads per span. Buffers hold at most kMaxEvents each;
+// later events are dropped and counted, which bounds both the memory and
+// the time spent tracing a long run. While tracing is off, a Span is a
+// single relaxed load.
+
+inline constexpr size_t kMaxEvents = size_t{1} << 20;
+// Sampled events stop this far short of kMaxEvents, so that they cannot
+// crowd out the spans of the phases they are part of.
+inline constexpr size_t kReservedEvents = size_t{1} << 16;
+
+namespace internal {
+inline std::atomic<bool> enabled{false};
+inline std::atomic<uint32_t> sampleInterval{0};
+}  // namespace internal
+
+inline bool enabled() {
+  return internal::enabled.load(std::memory_order_relaxed);
+}
+// Starts recording. If @sampleInterval is positive, the Evaluator also
+// records one node visit in every @sampleInterval.
+void start(uint32_t sampleInterval = 0);
+// Node visits between samples, or 0 if visits are not traced.
+inline uint32_t sampleInterval() {
+  return enabled() ? internal::sampleInterval.load(std::memory_order_relaxed)
+                   : 0;
+}
+// Nanoseconds since start().
+uint64_t now();
+// Records a span named @name, which must be a string literal, from @begin
+// to @end as returned by now(). @offset is a source offset, or -1.
+void record(const char* name, uint64_t begin, uint64_t end,
+            int64_t offset = -1);
+// Same as record(), for events sampled from a much larger population.
+void recordSample(const char* name, uint64_t begin, uint64_t end,
+                  int64_t offset = -1);
+// Stops recording and writes every event recorded so far to @path as JSON.
+// Must be called once the threads that recorded events are done. Returns
+// false if the file cannot be written.
+bool write(const std::string& path);
+
+// Records the lifetime of a scope as a span, if tracing is on.
+class Span {
+ public:
+  explicit Span(const char* name, int64_t offset = -1)
+    : name_(enabled() ? name : nullptr), offset_(offset) {
+    if (name_) begin_ = now();
+  }
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+  ~Span() {
+    if (name_) record(name_, begin_, now(), offset_);
+  }
+
+ private:
+  const char* name_;
+  int64_t offset_;
+  uint64_t begin_ = 0;
+};
+
+}  // namespace trace
+}  // namespace lox
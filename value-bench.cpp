@@ -0,0 +1,161 @@
+#include <any>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "value.hpp"
+
+namespace lox {
+namespace {
+
+// The std::variant based representation that ast::Value used before it was
+// NaN-boxed. Kept here as the baseline the benchmarks compare against.
+class VariantValue {
+ public:
+  VariantValue() = default;
+  VariantValue(bool b) : v_(b) {}
+  VariantValue(double d) : v_(d) {}
+  VariantValue(const std::string& s) : v_(s) {}
+  ast::ValueType type() const {
+    return static_cast<ast::ValueType>(v_.index());
+  }
+  bool b() const { return std::get<1>(v_); }
+  double d() const { return std::get<2>(v_); }
+  const std::string& s() const { return std::get<3>(v_); }
+
+ private:
+  std::variant<std::true_type, bool, double, std::string> v_;
+};
+
+constexpr int kNumValues = 4096;
+
+// Builds a mix of numbers, bools, nils and strings, mimicking the operands
+// the evaluator shuffles around.
+template <typename V> std::vector<V> makeMixed() {
+  std::vector<V> values;
+  values.reserve(kNumValues);
+  for (int i = 0; i < kNumValues; ++i) {
+    switch (i % 4) {
+      case 0: values.emplace_back(static_cast<double>(i)); break;
+      case 1: values.emplace_back(i % 3 == 0); break;
+      case 2: values.emplace_back(); break;
+      case 3: values.emplace_back(std::string("some string operand")); break;
+    }
+  }
+  return values;
+}
+
+template <typename V> std::vector<V> makeNumbers() {
+  std::vector<V> values;
+  values.reserve(kNumValues);
+  for (int i = 0; i < kNumValues; ++i) {
+    values.emplace_back(static_cast<double>(i) * 0.5);
+  }
+  return values;
+}
+
+template <typename V> void BM_CopyMixed(benchmark::State& state) {
+  const auto src = makeMixed<V>();
+  std::vector<V> dst(src.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < src.size(); ++i) dst[i] = src[i];
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * src.size());
+  state.counters["sizeof"] = sizeof(V);
+}
+
+// Mirrors the evaluator's Binary::STAR/PLUS path: check operand types,
+// unbox, compute and box the result into a fresh value.
+template <typename V> void BM_Arithmetic(benchmark::State& state) {
+  const auto lhs = makeNumbers<V>();
+  const auto rhs = makeNumbers<V>();
+  for (auto _ : state) {
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      if (lhs[i].type() != ast::ValueType::NUMBER ||
+          rhs[i].type() != ast::ValueType::NUMBER) {
+        state.SkipWithError("unexpected type");
+        break;
+      }
+      V result(lhs[i].d() * rhs[i].d() + 1.0);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * lhs.size());
+}
+
+// Same computation, but routed through std::any the way ast::Visitor returns
+// intermediate results. Values that fit std::any's small buffer avoid a heap
+// allocation per operation.
+template <typename V> void BM_ArithmeticAny(benchmark::State& state) {
+  const auto lhs = makeNumbers<V>();
+  const auto rhs = makeNumbers<V>();
+  for (auto _ : state) {
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      std::any first = lhs[i];
+      std::any second = rhs[i];
+      auto* a = std::any_cast<V>(&first);
+      auto* b = std::any_cast<V>(&second);
+      if (a->type() != ast::ValueType::NUMBER ||
+          b->type() != ast::ValueType::NUMBER) {
+        state.SkipWithError("unexpected type");
+        break;
+      }
+      std::any result = V(a->d() * b->d() + 1.0);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * lhs.size());
+}
+
+// Builds a string of state.range(0) pieces with Binary::PLUS, appending
+// when state.range(1) is 0 and prepending otherwise, then prints it. Copy
+// concatenates the way the evaluator did before ropes, copying both operands
+// into a new string every time.
+enum class Concat { COPY, ROPE };
+
+template <Concat C> void BM_Concat(benchmark::State& state) {
+  const int pieces = state.range(0);
+  const bool prepend = state.range(1);
+  std::vector<ast::Value> src;
+  for (int i = 0; i < 16; ++i) {
+    src.emplace_back(std::string(8 + i * 4, 'a' + i));
+  }
+  size_t length = 0;
+  for (auto _ : state) {
+    ast::Value str{std::string()};
+    for (int i = 0; i < pieces; ++i) {
+      const ast::Value& a = prepend ? src[i % src.size()] : str;
+      const ast::Value& b = prepend ? str : src[i % src.size()];
+      if constexpr (C == Concat::COPY) {
+        str = ast::Value(a.s() + b.s());
+      } else {
+        str = ast::Value::concat(a, b);
+      }
+    }
+    length = str.s().size();
+    benchmark::DoNotOptimize(str.s().data());
+  }
+  state.SetItemsProcessed(state.iterations() * pieces);
+  state.SetBytesProcessed(state.iterations() * length);
+}
+
+BENCHMARK_TEMPLATE(BM_Concat, Concat::COPY)
+    ->Ranges({{1 << 10, 1 << 14}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_Concat, Concat::ROPE)
+    ->Ranges({{1 << 10, 1 << 16}, {0, 1}});
+
+BENCHMARK_TEMPLATE(BM_CopyMixed, VariantValue);
+BENCHMARK_TEMPLATE(BM_CopyMixed, ast::Value);
+BENCHMARK_TEMPLATE(BM_Arithmetic, VariantValue);
+BENCHMARK_TEMPLATE(BM_Arithmetic, ast::Value);
+BENCHMARK_TEMPLATE(BM_ArithmeticAny, VariantValue);
+BENCHMARK_TEMPLATE(BM_ArithmeticAny, ast::Value);
+
+}  // namespace
+}  // namespace lox
+
+BENCHMARK_MAIN();
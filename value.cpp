@@ -0,0 +1,191 @@
+#include "value.hpp"
+
+#include <algorithm>
+
+namespace lox {
+namespace ast {
+
+namespace {
+
+// Concatenations no longer than this are copied rather than turned into a
+// rope, so that ropes are made of leaves worth the indirection.
+constexpr size_t kShortLeaf = 256;
+// Ropes deeper than this are rebalanced, which bounds the recursion of
+// flattening and destroying them.
+constexpr uint32_t kMaxDepth = 48;
+
+bool isLeaf(const Obj* obj) {
+  return obj->kind == Obj::Kind::STRING ||
+         static_cast<const ConcatObj*>(obj)->flattened();
+}
+
+const std::string& leafString(const Obj* obj) {
+  return obj->kind == Obj::Kind::STRING
+             ? static_cast<const StringObj*>(obj)->str
+             : static_cast<const ConcatObj*>(obj)->flat;
+}
+
+uint32_t depthOf(const Obj* obj) {
+  return isLeaf(obj) ? 0 : static_cast<const ConcatObj*>(obj)->depth;
+}
+
+size_t lengthOf(const Obj* obj) {
+  return isLeaf(obj) ? leafString(obj).size()
+                     : static_cast<const ConcatObj*>(obj)->length;
+}
+
+// Joins @left and @right, taking over a reference to each.
+ConcatObj* join(Obj* left, Obj* right) {
+  return new ConcatObj(left, right, lengthOf(left) + lengthOf(right),
+                       std::max(depthOf(left), depthOf(right)) + 1);
+}
+
+void appendTo(const Obj* obj, std::string* out) {
+  if (isLeaf(obj)) {
+    *out += leafString(obj);
+    return;
+  }
+  auto* rope = static_cast<const ConcatObj*>(obj);
+  appendTo(rope->left, out);
+  appendTo(rope->right, out);
+}
+
+// Minimum length of a balanced rope of each depth: Fibonacci numbers, so
+// that balanced ropes are about as deep as AVL trees of the same leaves.
+struct MinLengths {
+  MinLengths() {
+    len[0] = 1;
+    len[1] = 2;
+    for (uint32_t i = 2; i < kSize; ++i) len[i] = len[i - 1] + len[i - 2];
+  }
+  static constexpr uint32_t kSize = kMaxDepth + 2;
+  uint64_t len[kSize];
+};
+const MinLengths minLengths;
+
+bool isBalanced(const Obj* obj) {
+  return isLeaf(obj) ||
+         lengthOf(obj) >= minLengths.len[depthOf(obj)];
+}
+
+// Like join(), but copies two leaves short enough to be one.
+Obj* cat(Obj* left, Obj* right) {
+  if (not left) return right;
+  if (isLeaf(left) && isLeaf(right) &&
+      lengthOf(left) + lengthOf(right) <= kShortLeaf) {
+    Obj* leaf = new StringObj(leafString(left) + leafString(right));
+    release(left);
+    release(right);
+    return leaf;
+  }
+  return join(left, right);
+}
+
+// Rebalancing after Boehm, Atkinson and Plass, "Ropes: an Alternative to
+// Strings". Balanced subtrees, in practice everything but the chain of
+// concatenations that pushed the rope past kMaxDepth, are kept whole and
+// added in order to a forest in which slot i holds a balanced rope of length
+// in [minLengths.len[i], minLengths.len[i + 1]). Adding one merges it with
+// the slots of shorter ropes, so that the forest stays balanced.
+class Rebalancer {
+ public:
+  Obj* run(Obj* rope) {
+    insert(rope);
+    Obj* sum = nullptr;
+    for (Obj*& slot : slots_) {
+      if (slot) sum = sum ? join(slot, sum) : slot;
+    }
+    release(rope);
+    return sum;
+  }
+
+ private:
+  void insert(Obj* obj) {
+    if (isBalanced(obj)) {
+      retain(obj);
+      add(obj);
+      return;
+    }
+    auto* rope = static_cast<ConcatObj*>(obj);
+    insert(rope->left);
+    insert(rope->right);
+  }
+
+  void add(Obj* obj) {
+    const uint64_t* minLen = minLengths.len;
+    const size_t len = lengthOf(obj);
+    Obj* sum = nullptr;
+    uint32_t i = 0;
+    for (; i + 1 < kSlots && len > minLen[i + 1]; ++i) {
+      if (slots_[i]) {
+        sum = sum ? join(slots_[i], sum) : slots_[i];
+        slots_[i] = nullptr;
+      }
+    }
+    sum = cat(sum, obj);
+    for (; i < kSlots && lengthOf(sum) >= minLen[i]; ++i) {
+      if (slots_[i]) {
+        sum = cat(slots_[i], sum);
+        slots_[i] = nullptr;
+      }
+    }
+    slots_[i - 1] = sum;
+  }
+
+  static constexpr uint32_t kSlots = MinLengths::kSize;
+  Obj* slots_[kSlots] = {};
+};
+
+Obj* rebalance(Obj* rope) { return Rebalancer().run(rope); }
+
+}  // namespace
+
+Value Value::concat(const Value& a, const Value& b) {
+  Obj* x = a.obj();
+  Obj* y = b.obj();
+  const size_t lx = lengthOf(x);
+  const size_t ly = lengthOf(y);
+  if (ly == 0) return a;
+  if (lx == 0) return b;
+  if (lx + ly <= kShortLeaf) return Value(a.s() + b.s());
+  // Appending short pieces one at a time folds them into the rightmost leaf,
+  // (l + r) + y => l + (r + y), instead of growing the rope by a level each.
+  // Prepending mirrors it.
+  if (ly < kShortLeaf && not isLeaf(x)) {
+    auto* rope = static_cast<ConcatObj*>(x);
+    if (isLeaf(rope->right) && lengthOf(rope->right) + ly <= kShortLeaf) {
+      retain(rope->left);
+      return adopt(join(rope->left,
+                        new StringObj(leafString(rope->right) + b.s())));
+    }
+  }
+  if (lx < kShortLeaf && not isLeaf(y)) {
+    auto* rope = static_cast<ConcatObj*>(y);
+    if (isLeaf(rope->left) && lx + lengthOf(rope->left) <= kShortLeaf) {
+      retain(rope->right);
+      return adopt(join(new StringObj(a.s() + leafString(rope->left)),
+                        rope->right));
+    }
+  }
+  retain(x);
+  retain(y);
+  ConcatObj* rope = join(x, y);
+  if (rope->depth > kMaxDepth) return adopt(rebalance(rope));
+  return adopt(rope);
+}
+
+const std::string& Value::flatten(ConcatObj* rope) {
+  if (not rope->flattened()) {
+    rope->flat.reserve(rope->length);
+    appendTo(rope->left, &rope->flat);
+    appendTo(rope->right, &rope->flat);
+    release(rope->left);
+    release(rope->right);
+    rope->left = rope->right = nullptr;
+    rope->depth = 0;
+  }
+  return rope->flat;
+}
+
+}  // namespace ast
+}  // namespace lox
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include "intern.hpp"
+#include "object.hpp"
+
+namespace lox {
+namespace ast {
+
+enum class ValueType { NIL = 0, BOOL = 1, NUMBER = 2, STRING = 3 };
+
+// Runtime value produced by evaluating Lox expressions. Shared by the
+// tree-walking Evaluator and the bytecode VM.
+//
+// Values are NaN-boxed into a single 64-bit word. Any bit pattern that is not
+// a quiet NaN with all of kQNan set is a plain double. The remaining
+// patterns encode nil and the two booleans as small tags in the payload, and
+// heap objects as a pointer in the low 48 bits with the sign bit set.
+class Value {
+ public:
+  static Value Nil() { return Value(); }
+  Value() : bits_(kNil) {}
+  Value(bool b) : bits_(b ? kTrue : kFalse) {}
+  Value(double d) : bits_(box(d)) {}
+  Value(const std::string& s) : bits_(box(new StringObj(s))) {}
+  Value(std::string&& s) : bits_(box(new StringObj(std::move(s)))) {}
+  Value(Symbol s) : bits_(box(s.obj() ? s.obj() : intern("").obj())) {}
+  Value(const Value& o) : bits_(o.bits_) {
+    if (o.isObj()) retain(o.obj());
+  }
+  Value(Value&& o) noexcept : bits_(o.bits_) { o.bits_ = kNil; }
+  Value& operator=(const Value& o) {
+    if (o.isObj()) retain(o.obj());
+    if (isObj()) release(obj());
+    bits_ = o.bits_;
+    return *this;
+  }
+  Value& operator=(Value&& o) noexcept {
+    const uint64_t bits = o.bits_;
+    o.bits_ = kNil;
+    set(bits);
+    return *this;
+  }
+  ~Value() {
+    if (isObj()) release(obj());
+  }
+
+  void setNil() { set(kNil); }
+  void setBool(bool b) { set(b ? kTrue : kFalse); }
+  void setDouble(double d) { set(box(d)); }
+  void setString(const std::string& s) { *this = Value(s); }
+  void setString(std::string&& s) { *this = Value(std::move(s)); }
+  // Concatenation of the strings @a and @b in O(1), as a rope that is
+  // flattened by the first call to s() or equals() that needs its contents.
+  static Value concat(const Value& a, const Value& b);
+
+  ValueType type() const {
+    if (isNumber()) return ValueType::NUMBER;
+    if (isObj()) return ValueType::STRING;
+    return bits_ == kNil ? ValueType::NIL : ValueType::BOOL;
+  }
+  bool b() const { return bits_ == kTrue; }
+  double d() const {
+    double d;
+    std::memcpy(&d, &bits_, sizeof(d));
+    return d;
+  }
+  const std::string& s() const {
+    Obj* o = obj();
+    if (o->kind == Obj::Kind::STRING) return static_cast<StringObj*>(o)->str;
+    return flatten(static_cast<ConcatObj*>(o));
+  }
+  // Length of a string, without flattening it.
+  size_t length() const { return lengthOf(obj()); }
+  bool equals(const Value& o) const {
+    if (isNumber() && o.isNumber()) return d() == o.d();
+    if (bits_ == o.bits_) return true;
+    if (not isObj() || not o.isObj()) return false;
+    Obj* a = obj();
+    Obj* b = o.obj();
+    // Distinct interned strings never share contents.
+    if (a->kind == Obj::Kind::STRING && b->kind == Obj::Kind::STRING &&
+        static_cast<StringObj*>(a)->interned &&
+        static_cast<StringObj*>(b)->interned) {
+      return false;
+    }
+    return lengthOf(a) == lengthOf(b) && s() == o.s();
+  }
+
+ private:
+  static constexpr uint64_t kSignBit = 0x8000000000000000ull;
+  static constexpr uint64_t kQNan = 0x7ffc000000000000ull;
+  static constexpr uint64_t kNil = kQNan | 1;
+  static constexpr uint64_t kFalse = kQNan | 2;
+  static constexpr uint64_t kTrue = kQNan | 3;
+  // Quiet NaN that colliding doubles are canonicalized to, so that no
+  // double is ever mistaken for one of the tagged encodings above.
+  static constexpr uint64_t kCanonicalNan = 0x7ff8000000000000ull;
+
+  static uint64_t box(double d) {
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    // Only NaNs whose payload collides with the tagged encodings need to be
+    // rewritten. Arithmetic never produces them, so the branch is free.
+    if (__builtin_expect((bits & kQNan) == kQNan, 0)) return kCanonicalNan;
+    return bits;
+  }
+  static Value adopt(Obj* obj) {
+    Value v;
+    v.bits_ = box(obj);
+    return v;
+  }
+  static size_t lengthOf(const Obj* obj) {
+    return obj->kind == Obj::Kind::STRING
+               ? static_cast<const StringObj*>(obj)->str.size()
+               : static_cast<const ConcatObj*>(obj)->length;
+  }
+  static const std::string& flatten(ConcatObj* rope);
+  static uint64_t box(Obj* obj) {
+    return kSignBit | kQNan | reinterpret_cast<uintptr_t>(obj);
+  }
+  bool isNumber() const { return (bits_ & kQNan) != kQNan; }
+  bool isObj() const {
+    return (bits_ & (kQNan | kSignBit)) == (kQNan | kSignBit);
+  }
+  Obj* obj() const {
+    return reinterpret_cast<Obj*>(bits_ & ~(kSignBit | kQNan));
+  }
+  void set(uint64_t bits) {
+    if (isObj()) release(obj());
+    bits_ = bits;
+  }
+
+  uint64_t bits_;
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "Value must be one word");
+
+}  // namespace ast
+}  // namespace lox
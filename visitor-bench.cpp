@@ -0,0 +1,154 @@
+#include <any>
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "ast-eval.hpp"
+#include "ast.hpp"
+#include "error-reporter.hpp"
+#include "parser.hpp"
+
+namespace lox {
+namespace {
+
+// Evaluator built on the type-erased ast::Visitor, as EvalVisitor was before
+// it moved to TypedVisitor. Every intermediate Value travels through a
+// std::any and is recovered with any_cast.
+struct AnyEvalVisitor : public ast::Visitor {
+  std::any visitNumber(const ast::Number* obj) override {
+    return ast::Value(obj->val);
+  }
+  std::any visitString(const ast::String* obj) override {
+    return ast::Value(obj->val);
+  }
+  std::any visitBool(const ast::Bool* obj) override {
+    return ast::Value(obj->val);
+  }
+  std::any visitNil(const ast::Nil*) override { return ast::Value::Nil(); }
+  std::any visitUnary(const ast::Unary* obj) override {
+    auto operandAny = obj->operand->accept(this);
+    auto* operand = std::any_cast<ast::Value>(&operandAny);
+    ast::Value result;
+    if (ast::Evaluator::unary(obj->op, *operand, &result)) throw obj;
+    return result;
+  }
+  std::any visitBinary(const ast::Binary* obj) override {
+    auto firstAny = obj->first->accept(this);
+    auto* first = std::any_cast<ast::Value>(&firstAny);
+    auto secondAny = obj->second->accept(this);
+    auto* second = std::any_cast<ast::Value>(&secondAny);
+    ast::Value result;
+    if (ast::Evaluator::binary(obj->op, *first, *second, &result)) {
+      throw obj;
+    }
+    return result;
+  }
+};
+
+// Counts nodes; isolates the cost of dispatch itself.
+struct AnyCountVisitor : public ast::Visitor {
+  std::any visitNumber(const ast::Number*) override { return 1; }
+  std::any visitString(const ast::String*) override { return 1; }
+  std::any visitBool(const ast::Bool*) override { return 1; }
+  std::any visitNil(const ast::Nil*) override { return 1; }
+  std::any visitUnary(const ast::Unary* obj) override {
+    return 1 + std::any_cast<int>(obj->operand->accept(this));
+  }
+  std::any visitBinary(const ast::Binary* obj) override {
+    return 1 + std::any_cast<int>(obj->first->accept(this)) +
+           std::any_cast<int>(obj->second->accept(this));
+  }
+};
+
+struct TypedCountVisitor
+    : public ast::TypedVisitor<TypedCountVisitor, int> {
+  int visitNumber(const ast::Number*) { return 1; }
+  int visitString(const ast::String*) { return 1; }
+  int visitBool(const ast::Bool*) { return 1; }
+  int visitNil(const ast::Nil*) { return 1; }
+  int visitUnary(const ast::Unary* obj) { return 1 + visit(obj->operand); }
+  int visitBinary(const ast::Binary* obj) {
+    return 1 + visit(obj->first) + visit(obj->second);
+  }
+};
+
+// A balanced expression mixing arithmetic, comparisons, negation and string
+// concatenation, with roughly 2^depth leaves.
+std::string makeExpression(int depth, int* counter) {
+  if (depth == 0) {
+    switch ((*counter)++ % 3) {
+      case 0: return "1.5";
+      case 1: return "2";
+      default: return "-3";
+    }
+  }
+  const std::string lhs = makeExpression(depth - 1, counter);
+  const std::string rhs = makeExpression(depth - 1, counter);
+  switch (depth % 3) {
+    case 0: return "(" + lhs + " * " + rhs + ")";
+    case 1: return "(" + lhs + " + " + rhs + ")";
+    default: return "(" + lhs + " - " + rhs + ")";
+  }
+}
+
+const std::string& expression() {
+  static const std::string expr = [] {
+    int counter = 0;
+    return "(" + makeExpression(14, &counter) + ") > 0 == !nil";
+  }();
+  return expr;
+}
+
+ast::Tree parse(const std::string& expr) {
+  ErrorReporter err(expr);
+  Parser parser(&err, expr.begin(), expr.end());
+  return parser.parse();
+}
+
+void BM_EvalAny(benchmark::State& state) {
+  const auto tree = parse(expression());
+  for (auto _ : state) {
+    AnyEvalVisitor visitor;
+    auto result = tree->accept(&visitor);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * (1 << 14));
+}
+
+void BM_EvalTyped(benchmark::State& state) {
+  const auto tree = parse(expression());
+  for (auto _ : state) {
+    ast::Value result;
+    auto status = ast::Evaluator::eval(tree.get(), &result);
+    if (not status.ok) state.SkipWithError(status.message.c_str());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * (1 << 14));
+}
+
+void BM_CountAny(benchmark::State& state) {
+  const auto tree = parse(expression());
+  for (auto _ : state) {
+    AnyCountVisitor visitor;
+    benchmark::DoNotOptimize(std::any_cast<int>(tree->accept(&visitor)));
+  }
+  state.SetItemsProcessed(state.iterations() * (1 << 14));
+}
+
+void BM_CountTyped(benchmark::State& state) {
+  const auto tree = parse(expression());
+  for (auto _ : state) {
+    TypedCountVisitor visitor;
+    benchmark::DoNotOptimize(visitor.visit(tree.get()));
+  }
+  state.SetItemsProcessed(state.iterations() * (1 << 14));
+}
+
+BENCHMARK(BM_EvalAny);
+BENCHMARK(BM_EvalTyped);
+BENCHMARK(BM_CountAny);
+BENCHMARK(BM_CountTyped);
+
+}  // namespace
+}  // namespace lox
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "ast-eval.hpp"
+#include "ast.hpp"
+#include "chunk.hpp"
+#include "value.hpp"
+
+namespace lox {
+namespace vm {
+
+// Stack based virtual machine that executes Chunks produced by the Compiler.
+// Operators are applied by the tree-walking Evaluator's helpers, so runtime
+// errors carry the same messages, attributed to the source location of the
+// failing operator.
+class VM {
+ public:
+  struct Status {
+    Status() { ok = true; }
+    Status(const std::string& msg, int loc)
+      : ok(false), message(msg), location(loc) {}
+    bool ok;
+    std::string message;
+    int location = 0;  // location for the error.
+  };
+
+  static Status run(const Chunk& chunk, ast::Value* value) {
+    VM vm(chunk);
+    return vm.execute(value);
+  }
+
+ private:
+  VM(const Chunk& chunk) : chunk_(chunk) { stack_.resize(chunk.maxStack()); }
+
+  Status execute(ast::Value* value) {
+    const uint8_t* code = chunk_.code();
+    const uint8_t* ip = code;
+    ast::Value* sp = stack_.data();
+    // Operators share their semantics and error messages with the
+    // Evaluator. @op is a constant at every call, so the helpers' own
+    // switches fold away once inlined. On failure they leave the message in
+    // @msg for error().
+    const char* msg = nullptr;
+    auto error = [&] { return Status{msg, chunk_.location(ip - 1 - code)}; };
+    auto unary = [&](ast::Unary::Operator op) {
+      msg = ast::Evaluator::unary(op, sp[-1], &sp[-1]);
+      return msg == nullptr;
+    };
+    auto binary = [&](ast::Binary::Operator op) {
+      msg = ast::Evaluator::binary(op, sp[-2], sp[-1], &sp[-2]);
+      if (msg) return false;
+      --sp;
+      return true;
+    };
+    while (true) {
+      switch (static_cast<OpCode>(*ip++)) {
+        case OpCode::CONSTANT:
+          *sp++ = chunk_.constant(*ip++);
+          break;
+        case OpCode::CONSTANT_LONG: {
+          const size_t idx = ip[0] | (ip[1] << 8) | (ip[2] << 16);
+          ip += 3;
+          *sp++ = chunk_.constant(idx);
+          break;
+        }
+        case OpCode::NIL:
+          (sp++)->setNil();
+          break;
+        case OpCode::TRUE:
+          (sp++)->setBool(true);
+          break;
+        case OpCode::FALSE:
+          (sp++)->setBool(false);
+          break;
+        case OpCode::NEGATE:
+          if (not unary(ast::Unary::MINUS)) return error();
+          break;
+        case OpCode::NOT:
+          if (not unary(ast::Unary::BANG)) return error();
+          break;
+        case OpCode::ADD:
+          if (not binary(ast::Binary::PLUS)) return error();
+          break;
+        case OpCode::SUBTRACT:
+          if (not binary(ast::Binary::MINUS)) return error();
+          break;
+        case OpCode::MULTIPLY:
+          if (not binary(ast::Binary::STAR)) return error();
+          break;
+        case OpCode::DIVIDE:
+          if (not binary(ast::Binary::SLASH)) return error();
+          break;
+        case OpCode::EQUAL:
+          if (not binary(ast::Binary::EQUAL_EQUAL)) return error();
+          break;
+        case OpCode::NOT_EQUAL:
+          if (not binary(ast::Binary::BANG_EQUAL)) return error();
+          break;
+        case OpCode::GREATER:
+          if (not binary(ast::Binary::GREATER)) return error();
+          break;
+        case OpCode::GREATER_EQUAL:
+          if (not binary(ast::Binary::GREATER_EQUAL)) return error();
+          break;
+        case OpCode::LESS:
+          if (not binary(ast::Binary::LESS)) return error();
+          break;
+        case OpCode::LESS_EQUAL:
+          if (not binary(ast::Binary::LESS_EQUAL)) return error();
+          break;
+        case OpCode::RETURN:
+          *value = sp[-1];
+          return {};
+      }
+    }
+  }
+
+  const Chunk& chunk_;
+  std::vector<ast::Value> stack_;
+};
+
+}  // namespace vm
+}  // namespace lox